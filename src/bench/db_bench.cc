@@ -0,0 +1,215 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Insert throughput of the DB cache, for each of the settings that
+// trade durability for speed: SQLite's synchronous and journal modes,
+// and how many packets share a transaction. Packets are summary and
+// detailed reports, decoded like the dispatcher does, and handed to
+// DBInterface in batches, like the DB sink does. Every setting starts
+// from an empty database, in a directory under dir; use a directory on
+// the disk the cache lives on, as /tmp may well not sync at all. Only
+// the time spent in DBInterface is counted.
+//
+// Usage: db_bench [packets] [dir]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "lib/configurator.h"
+#include "lib/db_interface.h"
+#include "lib/msg_pool.h"
+#include "lib/report_decoder.h"
+
+using freud::lib::Configurator;
+using freud::lib::DBInterface;
+using freud::lib::MsgBuffer;
+using freud::lib::MsgPool;
+using freud::lib::ReportDecoder;
+
+// packets per call, as dispatch_batch_size
+#define BATCH 64
+// slow settings stop early, their rate is still meaningful
+#define MAX_SEC_PER_SETTING 10
+// reports are 100 usec apart
+#define REPORT_INTERVAL_USEC 100
+
+namespace {
+
+struct Setting {
+  const char *synchronous;
+  const char *journal_mode;
+  uint32_t commit_max_packets;
+  uint32_t commit_max_msec;
+  bool index_metadata;
+};
+
+const Setting kSettings[] = {
+  // the defaults, then each synchronous mode
+  { "normal", "wal", 1000, 100, true },
+  { "off", "wal", 1000, 100, true },
+  { "full", "wal", 1000, 100, true },
+  { "extra", "wal", 1000, 100, true },
+  // groups are only committed between batches: a commit per batch,
+  // then smaller and larger groups
+  { "normal", "wal", 1, 100, true },
+  { "normal", "wal", 256, 100, true },
+  { "normal", "wal", 10000, 100, true },
+  // groups cut by time rather than by size
+  { "normal", "wal", 1000000, 10, true },
+  { "normal", "wal", 1000000, 1000, true },
+  // the rollback journal
+  { "normal", "delete", 1000, 100, true },
+  { "full", "delete", 1000, 100, true },
+  { "full", "delete", 1, 100, true },
+  // the defaults without the metadata index, last: see main()
+  { "normal", "wal", 1000, 100, false },
+};
+
+int64_t get_monotonic_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// same mix as the field: one detailed report out of five, a few
+// processes and modules
+void fill_report(const uint64_t i, const uint64_t usec_ts, freudpb::Report *report) {
+  const bool detailed = i % 5 == 0;
+  report->Clear();
+  report->set_pid(1000 + i % 7);
+  report->set_procname("/usr/bin/proc" + std::to_string(i % 3));
+  report->set_pgname("pg" + std::to_string(i % 2));
+  report->set_type(detailed ? freudpb::Report::DETAILED : freudpb::Report::SUMMARY);
+  report->set_usec_ts(usec_ts);
+  report->set_module_name("mod_" + std::to_string(i % 4));
+  report->set_instance_id(i);
+  if (detailed) {
+    for (int t = 0; t < 12; ++t)
+      report->add_trace(0x400000 + t * 16 + i % 4);
+    report->set_instance_info("instance info " + std::to_string(i));
+  }
+  freudpb::KeyValue *kv = report->add_module_info();
+  kv->set_key("count");
+  kv->set_type(freudpb::KeyValue::UINT64);
+  kv->set_value_u64(i);
+}
+
+// returns packets/sec, or a negative value on errors
+double run(const Setting &setting, const std::string &dir, const size_t packets) {
+  std::string db_dir = dir + "/db_bench.XXXXXX";
+  if (!mkdtemp(&db_dir[0])) {
+    perror("mkdtemp");
+    return -1;
+  }
+  const std::string conf_path = db_dir + "/sigmund.conf";
+  FILE *fp = fopen(conf_path.c_str(), "w");
+  if (!fp) {
+    perror("fopen");
+    return -1;
+  }
+  fprintf(fp, "db_dir=%s\ndb_synchronous=%s\ndb_journal_mode=%s\ndb_commit_max_packets=%u\n"
+          "db_commit_max_msec=%u\ndb_index_metadata=%s\n", db_dir.c_str(), setting.synchronous,
+          setting.journal_mode, setting.commit_max_packets, setting.commit_max_msec,
+          setting.index_metadata ? "true" : "false");
+  fclose(fp);
+  const char *argv[] = { "db_bench", conf_path.c_str() };
+  Configurator config(2, argv);
+
+  double rate = -1;
+  {
+    DBInterface db(config);
+    if (db.init()) {
+      const std::string hostname = "db_bench";
+      MsgPool pool(BATCH);
+      ReportDecoder decoder(pool, hostname);
+      // the pool holds exactly one batch
+      std::vector<MsgBuffer*> batch(BATCH);
+      (void) pool.acquire_batch(batch.data(), BATCH);
+
+      freudpb::Report report;
+      const uint64_t usec_ts_begin = time(NULL) * 1000000ULL;
+      int64_t elapsed = 0;
+      size_t cached = 0;
+      bool decoded = true;
+      while (decoded && cached < packets && elapsed < MAX_SEC_PER_SETTING * 1000000000LL) {
+        for (size_t i = 0; i < BATCH; ++i) {
+          fill_report(cached + i, usec_ts_begin + (cached + i) * REPORT_INTERVAL_USEC, &report);
+          batch[i]->set_size(report.ByteSizeLong());
+          report.SerializeToArray(batch[i]->data(), MsgBuffer::kCapacity);
+          decoded = decoded && decoder.decode(batch[i]);
+        }
+
+        const int64_t start = get_monotonic_nsec();
+        cached += db.cache_packets(batch.data(), BATCH);
+        (void) db.tick(false);
+        elapsed += get_monotonic_nsec() - start;
+      }
+
+      // the last group only counts once committed
+      const int64_t start = get_monotonic_nsec();
+      db.flush();
+      elapsed += get_monotonic_nsec() - start;
+      if (decoded)
+        rate = cached * 1e9 / elapsed;
+      else
+        fprintf(stderr, "ERROR: could not decode a report\n");
+      db.fini();
+
+      for (MsgBuffer *msg : batch)
+        msg->unref();
+    }
+  }
+
+  const std::string rm = "rm -rf " + db_dir;
+  if (system(rm.c_str()) != 0)
+    fprintf(stderr, "could not remove %s\n", db_dir.c_str());
+  return rate;
+}
+
+} // namespace
+
+int main(const int argc, const char *argv[]) {
+  const size_t packets = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+  const std::string dir = argc > 2 ? argv[2] : "/tmp";
+
+  const size_t settings = sizeof(kSettings) / sizeof(kSettings[0]);
+  double default_rate = 0;
+  for (size_t i = 0; i < settings; ++i) {
+    const Setting &setting = kSettings[i];
+    const double rate = run(setting, dir, packets);
+    if (rate < 0) {
+      fprintf(stderr, "ERROR: run failed\n");
+      return 1;
+    }
+    printf("synchronous=%-6s journal_mode=%-6s commit_max_packets=%-7u commit_max_msec=%-4u index_metadata=%-5s"
+           " %9.0f packets/s\n", setting.synchronous, setting.journal_mode, setting.commit_max_packets,
+           setting.commit_max_msec, setting.index_metadata ? "true" : "false", rate);
+    fflush(stdout);
+
+    if (i == 0) {
+      default_rate = rate;
+    } else if (i == settings - 1) {
+      const double slowdown_pct = 100 * (1 - default_rate / rate);
+      printf("index_metadata costs %.0f%% of the insert throughput, budget %d%%%s\n", slowdown_pct,
+             DB_INDEX_MAX_SLOWDOWN_PCT, slowdown_pct > DB_INDEX_MAX_SLOWDOWN_PCT ? ", OVER BUDGET" : "");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Cost of formatting floating-point values for the ES documents: the
+// snprintf() loop with increasing precision, checked with strtod(),
+// that JsonWriter used to rely on, against the shortest round-trip
+// conversion it uses now. Every new output is parsed back and checked.
+//
+// Usage: json_bench [values]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <vector>
+#include "lib/json_writer.h"
+
+namespace {
+
+int64_t get_monotonic_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+size_t snprintf_double(const double v, char *buf) {
+  for (int precision = 15; precision < 17; ++precision) {
+    const int len = snprintf(buf, 32, "%.*g", precision, v);
+    if (strtod(buf, NULL) == v)
+      return len;
+  }
+  return snprintf(buf, 32, "%.17g", v);
+}
+
+size_t snprintf_float(const float v, char *buf) {
+  int len = 0;
+  for (int precision = 6; precision <= 9; ++precision) {
+    len = snprintf(buf, 32, "%.*g", precision, (double) v);
+    if (strtof(buf, NULL) == v)
+      break;
+  }
+  return len;
+}
+
+template <typename T>
+void run(const char *name, const std::vector<T> &values, size_t (*format)(const T, char*), const bool check) {
+  char buf[32];
+  size_t bytes = 0, mismatches = 0;
+  const int64_t start = get_monotonic_nsec();
+  for (const T v : values)
+    bytes += format(v, buf);
+  const double elapsed = (get_monotonic_nsec() - start) / 1e9;
+
+  if (check)
+    for (const T v : values) {
+      buf[format(v, buf)] = '\0';
+      if ((T) strtod(buf, NULL) != v)
+        ++mismatches;
+    }
+
+  printf("%-36s %zu values in %.3f s, %.1f ns/value, %.1f chars/value%s\n",
+         name, values.size(), elapsed, elapsed * 1e9 / values.size(), (double) bytes / values.size(),
+         mismatches ? " (MISMATCH)" : "");
+}
+
+template <typename T>
+void compare(const char *what, const std::vector<T> &values, size_t (*before)(const T, char*),
+             size_t (*after)(const T, char*)) {
+  char name[64];
+  snprintf(name, sizeof(name), "%s, snprintf+strtod", what);
+  run(name, values, before, false);
+  snprintf(name, sizeof(name), "%s, shortest", what);
+  run(name, values, after, true);
+}
+
+} // namespace
+
+int main(const int argc, const char *argv[]) {
+  const size_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  std::mt19937_64 rng(42);
+
+  // arbitrary bit patterns: mostly 17-digit values with large exponents
+  std::vector<double> random_doubles;
+  while (random_doubles.size() < count) {
+    const uint64_t bits = rng();
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    if (isfinite(v))
+      random_doubles.push_back(v);
+  }
+  compare("random doubles", random_doubles, snprintf_double, freud::lib::format_double);
+
+  // what reports typically carry: measurements with a few decimals
+  std::vector<double> short_doubles;
+  std::uniform_int_distribution<int> cents(0, 10000000);
+  for (size_t i = 0; i < count; ++i)
+    short_doubles.push_back(cents(rng) / 100.0);
+  compare("2-decimal doubles", short_doubles, snprintf_double, freud::lib::format_double);
+
+  std::vector<float> floats;
+  std::uniform_real_distribution<float> real(0, 1000);
+  for (size_t i = 0; i < count; ++i)
+    floats.push_back(real(rng));
+  compare("uniform floats", floats, snprintf_float, freud::lib::format_float);
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Throughput of the inbound queue implementations: the mutex-based
+// SyncQueue that the dispatcher used to rely on, and the lock-free
+// RingQueue with its futex doorbell.
+//
+// Usage: queue_bench [messages] [capacity]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "lib/ring_queue.h"
+#include "lib/sync_queue.h"
+
+using freud::lib::RingQueue;
+using freud::lib::SyncQueue;
+
+namespace {
+
+int64_t get_monotonic_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// SyncQueue has no close(): consumers stop on a NULL datum, one per
+// consumer
+template <typename Queue>
+void close_queue(Queue *queue, const size_t consumers);
+
+template <>
+void close_queue(SyncQueue<uint64_t> *queue, const size_t consumers) {
+  for (size_t i = 0; i < consumers; ++i)
+    while (!queue->push(NULL))
+      std::this_thread::yield();
+}
+
+template <>
+void close_queue(RingQueue<uint64_t> *queue, const size_t) {
+  queue->close();
+}
+
+template <typename Queue>
+void run(const char *name, Queue *queue, const size_t producers, const size_t consumers,
+         const uint64_t messages) {
+  std::vector<uint64_t> values(messages);
+  for (uint64_t i = 0; i < messages; ++i)
+    values[i] = i;
+
+  std::atomic<uint64_t> popped(0), sum(0), full(0);
+  std::vector<std::thread*> threads;
+  const int64_t start = get_monotonic_nsec();
+
+  for (size_t c = 0; c < consumers; ++c)
+    threads.push_back(new std::thread([&] {
+      uint64_t local_popped = 0, local_sum = 0;
+      while (uint64_t *datum = queue->pop_or_wait()) {
+        ++local_popped;
+        local_sum += *datum;
+      }
+      popped += local_popped;
+      sum += local_sum;
+    }));
+
+  std::vector<std::thread*> writers;
+  for (size_t p = 0; p < producers; ++p)
+    writers.push_back(new std::thread([&, p] {
+      uint64_t local_full = 0;
+      for (uint64_t i = p; i < messages; i += producers)
+        while (!queue->push(&values[i])) {
+          // tail-drop: back off and retry, so that every message makes
+          // it through and the sums can be compared
+          ++local_full;
+          std::this_thread::yield();
+        }
+      full += local_full;
+    }));
+
+  for (std::thread *writer : writers) {
+    writer->join();
+    delete writer;
+  }
+  close_queue(queue, consumers);
+  for (std::thread *thread : threads) {
+    thread->join();
+    delete thread;
+  }
+
+  const double elapsed = (get_monotonic_nsec() - start) / 1e9;
+  const bool ok = popped == messages && sum == messages * (messages - 1) / 2;
+  printf("%-10s %zuP/%zuC: %" PRIu64 " msgs in %.3f s, %.2f M msgs/s, %.1f ns/msg, %" PRIu64
+         " full pushes%s\n",
+         name, producers, consumers, popped.load(), elapsed, messages / elapsed / 1e6,
+         elapsed * 1e9 / messages, full.load(), ok ? "" : " (MISMATCH)");
+}
+
+} // namespace
+
+int main(const int argc, const char *argv[]) {
+  const uint64_t messages = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+  const size_t capacity = argc > 2 ? strtoull(argv[2], NULL, 10) : 16384;
+
+  const size_t shapes[][2] = {{1, 1}, {2, 1}, {4, 2}};
+  for (const auto &shape : shapes) {
+    {
+      SyncQueue<uint64_t> queue(capacity);
+      run("SyncQueue", &queue, shape[0], shape[1], messages);
+    }
+    {
+      RingQueue<uint64_t> queue(capacity);
+      run("RingQueue", &queue, shape[0], shape[1], messages);
+    }
+  }
+
+  return 0;
+}
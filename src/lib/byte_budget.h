@@ -0,0 +1,72 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace freud {
+namespace lib {
+
+// Accounts for the bytes held by queued messages. Once usage would
+// exceed the high watermark, new reservations fail until usage has
+// fallen back to the low watermark, so that drops come in bursts
+// instead of flapping around the limit.
+class ByteBudget {
+ public:
+  ByteBudget(const uint64_t high_watermark, const uint64_t low_watermark)
+      : high_(high_watermark), low_(low_watermark < high_watermark ? low_watermark : high_watermark),
+        used_(0), shedding_(false) {}
+  ~ByteBudget() = default;
+
+  __attribute__((warn_unused_result))
+  bool try_reserve(const uint64_t bytes) {
+    if (shedding_.load(std::memory_order_relaxed)) {
+      if (used_.load(std::memory_order_relaxed) > low_)
+        return false;
+      shedding_.store(false, std::memory_order_relaxed);
+    }
+
+    const uint64_t prev = used_.fetch_add(bytes, std::memory_order_relaxed);
+    if (prev + bytes > high_) {
+      used_.fetch_sub(bytes, std::memory_order_relaxed);
+      shedding_.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  void release(const uint64_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  uint64_t get_high_watermark() const { return high_; }
+  uint64_t get_low_watermark() const { return low_; }
+  uint64_t get_used() const { return used_.load(std::memory_order_relaxed); }
+  bool is_shedding() const { return shedding_.load(std::memory_order_relaxed); }
+
+ private:
+  const uint64_t high_;
+  const uint64_t low_;
+  std::atomic<uint64_t> used_;
+  std::atomic<bool> shedding_;
+};
+
+} // namespace lib
+} // namespace freud
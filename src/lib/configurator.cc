@@ -18,7 +18,10 @@
 
 #include "lib/configurator.h"
 
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 namespace freud {
@@ -27,12 +30,72 @@ namespace lib {
 Configurator::Configurator() {
   database_directory_ = "/var/lib/sigmund/";
   portfile_filename_ = "/run/sigmund/portfile";
-  elastic_search_url_ = "http://localhost:9200/";
+  elastic_search_urls_.push_back("http://localhost:9200/");
   elastic_search_index_ = "analyst";
 
   cache_packets_in_db_ = false;
+  db_synchronous_ = "NORMAL";
+  db_journal_mode_ = "WAL";
+  db_journal_size_limit_ = 64 * 1024 * 1024;
+  db_commit_max_packets_ = 1000;
+  db_commit_max_msec_ = 100;
+  db_max_rows_ = 0;
+  db_max_bytes_ = 0;
+  db_max_age_sec_ = 0;
+  db_eviction_batch_rows_ = 1000;
+  db_index_metadata_ = true;
+  db_compression_ = false;
+  db_compression_level_ = 6;
+  db_dict_bytes_ = 8192;
+  db_dict_sample_rows_ = 1000;
+  db_dict_max_age_sec_ = 604800;
+  db_replay_on_start_ = false;
+  db_replay_max_rate_ = 1000;
   send_packets_to_es_ = true;
   forward_detailed_reports_ = false;
+
+  udp_batch_size_ = 32;
+  udp_listener_shards_ = 1;
+  msg_pool_size_ = 10240;
+  dispatch_batch_size_ = 64;
+  dispatch_batch_wait_usec_ = 1000;
+  inbound_high_watermark_bytes_ = 16 * 1024 * 1024;
+  inbound_low_watermark_bytes_ = 12 * 1024 * 1024;
+  summary_lane_.high_watermark_bytes = 4 * 1024 * 1024;
+  summary_lane_.low_watermark_bytes = 3 * 1024 * 1024;
+  summary_lane_.drop_oldest = false;
+  detailed_lane_.high_watermark_bytes = 12 * 1024 * 1024;
+  detailed_lane_.low_watermark_bytes = 9 * 1024 * 1024;
+  detailed_lane_.drop_oldest = false;
+  db_queue_.high_watermark_bytes = 16 * 1024 * 1024;
+  db_queue_.low_watermark_bytes = 12 * 1024 * 1024;
+  db_queue_.drop_oldest = false;
+  es_queue_.high_watermark_bytes = 16 * 1024 * 1024;
+  es_queue_.low_watermark_bytes = 12 * 1024 * 1024;
+  es_queue_.drop_oldest = false;
+  filter_.drop_summary = false;
+  filter_.drop_detailed = false;
+  es_bulk_max_bytes_ = 4 * 1024 * 1024;
+  es_bulk_max_docs_ = 1000;
+  es_bulk_linger_msec_ = 500;
+  es_bulk_max_retries_ = 3;
+  es_max_inflight_ = 4;
+  es_bulk_timeout_msec_ = 30000;
+  es_adaptive_ = false;
+  es_bulk_min_docs_ = 100;
+  es_min_inflight_ = 1;
+  es_target_p99_msec_ = 1000;
+  es_spool_max_bytes_ = 256 * 1024 * 1024;
+  es_spool_segment_bytes_ = 16 * 1024 * 1024;
+  es_balance_least_outstanding_ = false;
+  es_node_max_failures_ = 3;
+  es_node_eject_msec_ = 30000;
+  es_accept_past_sec_ = 7 * 24 * 3600;
+  es_accept_future_sec_ = 3600;
+  es_gzip_level_ = 0;
+  es_gzip_min_bytes_ = 1024;
+  es_trace_interning_ = false;
+  es_trace_cache_size_ = 65536;
 }
 
 Configurator::Configurator(const int argc, const char *argv[])
@@ -63,8 +126,8 @@ const std::string& Configurator::get_portfile_filename() const {
   return portfile_filename_;
 }
 
-const std::string& Configurator::get_elastic_search_url() const {
-  return elastic_search_url_;
+const std::vector<std::string>& Configurator::get_elastic_search_urls() const {
+  return elastic_search_urls_;
 }
 
 const std::string& Configurator::get_elastic_search_index() const {
@@ -75,6 +138,74 @@ bool Configurator::get_cache_packets_in_db() const {
   return cache_packets_in_db_;
 }
 
+const std::string& Configurator::get_db_synchronous() const {
+  return db_synchronous_;
+}
+
+const std::string& Configurator::get_db_journal_mode() const {
+  return db_journal_mode_;
+}
+
+uint64_t Configurator::get_db_journal_size_limit() const {
+  return db_journal_size_limit_;
+}
+
+uint32_t Configurator::get_db_commit_max_packets() const {
+  return db_commit_max_packets_;
+}
+
+uint32_t Configurator::get_db_commit_max_msec() const {
+  return db_commit_max_msec_;
+}
+
+uint64_t Configurator::get_db_max_rows() const {
+  return db_max_rows_;
+}
+
+uint64_t Configurator::get_db_max_bytes() const {
+  return db_max_bytes_;
+}
+
+uint32_t Configurator::get_db_max_age_sec() const {
+  return db_max_age_sec_;
+}
+
+uint32_t Configurator::get_db_eviction_batch_rows() const {
+  return db_eviction_batch_rows_;
+}
+
+bool Configurator::get_db_index_metadata() const {
+  return db_index_metadata_;
+}
+
+bool Configurator::get_db_compression() const {
+  return db_compression_;
+}
+
+int Configurator::get_db_compression_level() const {
+  return db_compression_level_;
+}
+
+uint32_t Configurator::get_db_dict_bytes() const {
+  return db_dict_bytes_;
+}
+
+uint32_t Configurator::get_db_dict_sample_rows() const {
+  return db_dict_sample_rows_;
+}
+
+uint32_t Configurator::get_db_dict_max_age_sec() const {
+  return db_dict_max_age_sec_;
+}
+
+bool Configurator::get_db_replay_on_start() const {
+  return db_replay_on_start_;
+}
+
+uint32_t Configurator::get_db_replay_max_rate() const {
+  return db_replay_max_rate_;
+}
+
 bool Configurator::get_send_packets_to_es() const {
   return send_packets_to_es_;
 }
@@ -83,6 +214,138 @@ bool Configurator::fwd_detailed_reports() const {
   return forward_detailed_reports_;
 }
 
+uint32_t Configurator::get_udp_batch_size() const {
+  return udp_batch_size_;
+}
+
+uint32_t Configurator::get_udp_listener_shards() const {
+  return udp_listener_shards_;
+}
+
+uint32_t Configurator::get_msg_pool_size() const {
+  return msg_pool_size_;
+}
+
+uint32_t Configurator::get_dispatch_batch_size() const {
+  return dispatch_batch_size_;
+}
+
+uint32_t Configurator::get_dispatch_batch_wait_usec() const {
+  return dispatch_batch_wait_usec_;
+}
+
+uint64_t Configurator::get_inbound_high_watermark_bytes() const {
+  return inbound_high_watermark_bytes_;
+}
+
+uint64_t Configurator::get_inbound_low_watermark_bytes() const {
+  return inbound_low_watermark_bytes_;
+}
+
+const Configurator::QueueConfig& Configurator::get_summary_lane() const {
+  return summary_lane_;
+}
+
+const Configurator::QueueConfig& Configurator::get_detailed_lane() const {
+  return detailed_lane_;
+}
+
+const Configurator::QueueConfig& Configurator::get_db_queue() const {
+  return db_queue_;
+}
+
+const Configurator::QueueConfig& Configurator::get_es_queue() const {
+  return es_queue_;
+}
+
+const Configurator::FilterConfig& Configurator::get_filter() const {
+  return filter_;
+}
+
+uint64_t Configurator::get_es_bulk_max_bytes() const {
+  return es_bulk_max_bytes_;
+}
+
+uint32_t Configurator::get_es_bulk_max_docs() const {
+  return es_bulk_max_docs_;
+}
+
+uint32_t Configurator::get_es_bulk_linger_msec() const {
+  return es_bulk_linger_msec_;
+}
+
+uint32_t Configurator::get_es_bulk_max_retries() const {
+  return es_bulk_max_retries_;
+}
+
+uint32_t Configurator::get_es_max_inflight() const {
+  return es_max_inflight_;
+}
+
+uint32_t Configurator::get_es_bulk_timeout_msec() const {
+  return es_bulk_timeout_msec_;
+}
+
+bool Configurator::get_es_adaptive() const {
+  return es_adaptive_;
+}
+
+uint32_t Configurator::get_es_bulk_min_docs() const {
+  return es_bulk_min_docs_;
+}
+
+uint32_t Configurator::get_es_min_inflight() const {
+  return es_min_inflight_;
+}
+
+uint32_t Configurator::get_es_target_p99_msec() const {
+  return es_target_p99_msec_;
+}
+
+uint64_t Configurator::get_es_spool_max_bytes() const {
+  return es_spool_max_bytes_;
+}
+
+uint64_t Configurator::get_es_spool_segment_bytes() const {
+  return es_spool_segment_bytes_;
+}
+
+bool Configurator::get_es_balance_least_outstanding() const {
+  return es_balance_least_outstanding_;
+}
+
+uint32_t Configurator::get_es_node_max_failures() const {
+  return es_node_max_failures_;
+}
+
+uint32_t Configurator::get_es_node_eject_msec() const {
+  return es_node_eject_msec_;
+}
+
+uint32_t Configurator::get_es_accept_past_sec() const {
+  return es_accept_past_sec_;
+}
+
+uint32_t Configurator::get_es_accept_future_sec() const {
+  return es_accept_future_sec_;
+}
+
+uint32_t Configurator::get_es_gzip_level() const {
+  return es_gzip_level_;
+}
+
+uint64_t Configurator::get_es_gzip_min_bytes() const {
+  return es_gzip_min_bytes_;
+}
+
+bool Configurator::get_es_trace_interning() const {
+  return es_trace_interning_;
+}
+
+uint32_t Configurator::get_es_trace_cache_size() const {
+  return es_trace_cache_size_;
+}
+
 void Configurator::read_config_from_file(FILE *fp) {
   char *buf = NULL;
   size_t buflen = 0;
@@ -110,10 +373,11 @@ void Configurator::read_config_from_file(FILE *fp) {
       else
         fprintf(stderr, "NOTICE: using portfile '%s'\n", portfile_filename_.c_str());
     } else if (strncmp(buf, "es_url=", strlen("es_url=")) == 0) {
-      if (!parse_string(buf + strlen("es_url="), &elastic_search_url_))
+      if (!parse_string_list(buf + strlen("es_url="), &elastic_search_urls_))
         fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
       else
-        fprintf(stderr, "NOTICE: using Elastic Search URL '%s'\n", elastic_search_url_.c_str());
+        for (const std::string &url : elastic_search_urls_)
+          fprintf(stderr, "NOTICE: using Elastic Search URL '%s'\n", url.c_str());
     } else if (strncmp(buf, "es_index=", strlen("es_index=")) == 0) {
       if (!parse_string(buf + strlen("es_index="), &elastic_search_index_))
         fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
@@ -124,6 +388,114 @@ void Configurator::read_config_from_file(FILE *fp) {
         fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
       else
         fprintf(stderr, "NOTICE:%s sending packets to DB\n", cache_packets_in_db_ ? "" : " NOT");
+    } else if (strncmp(buf, "db_synchronous=", strlen("db_synchronous=")) == 0) {
+      const char *value = buf + strlen("db_synchronous=");
+      if (strcmp(value, "off") == 0 || strcmp(value, "normal") == 0 || strcmp(value, "full") == 0 ||
+          strcmp(value, "extra") == 0) {
+        db_synchronous_ = value;
+        fprintf(stderr, "NOTICE: using DB synchronous mode '%s'\n", db_synchronous_.c_str());
+      } else {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      }
+    } else if (strncmp(buf, "db_journal_mode=", strlen("db_journal_mode=")) == 0) {
+      const char *value = buf + strlen("db_journal_mode=");
+      if (strcmp(value, "wal") == 0 || strcmp(value, "delete") == 0 || strcmp(value, "truncate") == 0 ||
+          strcmp(value, "persist") == 0) {
+        db_journal_mode_ = value;
+        fprintf(stderr, "NOTICE: using DB journal mode '%s'\n", db_journal_mode_.c_str());
+      } else {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      }
+    } else if (strncmp(buf, "db_journal_size_limit=", strlen("db_journal_size_limit=")) == 0) {
+      if (!parse_uint64(buf + strlen("db_journal_size_limit="), &db_journal_size_limit_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: truncating the DB journal to %" PRIu64 " bytes\n", db_journal_size_limit_);
+    } else if (strncmp(buf, "db_commit_max_packets=", strlen("db_commit_max_packets=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("db_commit_max_packets="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        db_commit_max_packets_ = value;
+        fprintf(stderr, "NOTICE: committing DB transactions at %u packets\n", db_commit_max_packets_);
+      }
+    } else if (strncmp(buf, "db_commit_max_msec=", strlen("db_commit_max_msec=")) == 0) {
+      if (!parse_uint32(buf + strlen("db_commit_max_msec="), &db_commit_max_msec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: committing DB transactions after %u msec\n", db_commit_max_msec_);
+    } else if (strncmp(buf, "db_max_rows=", strlen("db_max_rows=")) == 0) {
+      if (!parse_uint64(buf + strlen("db_max_rows="), &db_max_rows_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: keeping at most %" PRIu64 " rows in the DB\n", db_max_rows_);
+    } else if (strncmp(buf, "db_max_bytes=", strlen("db_max_bytes=")) == 0) {
+      if (!parse_uint64(buf + strlen("db_max_bytes="), &db_max_bytes_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: keeping at most %" PRIu64 " bytes in the DB\n", db_max_bytes_);
+    } else if (strncmp(buf, "db_max_age_sec=", strlen("db_max_age_sec=")) == 0) {
+      if (!parse_uint32(buf + strlen("db_max_age_sec="), &db_max_age_sec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: keeping DB rows for at most %u sec\n", db_max_age_sec_);
+    } else if (strncmp(buf, "db_eviction_batch_rows=", strlen("db_eviction_batch_rows=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("db_eviction_batch_rows="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        db_eviction_batch_rows_ = value;
+        fprintf(stderr, "NOTICE: evicting DB rows in batches of %u\n", db_eviction_batch_rows_);
+      }
+    } else if (strncmp(buf, "db_index_metadata=", strlen("db_index_metadata=")) == 0) {
+      if (!parse_bool(buf + strlen("db_index_metadata="), &db_index_metadata_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE:%s indexing DB rows by time and module\n", db_index_metadata_ ? "" : " NOT");
+    } else if (strncmp(buf, "db_compression=", strlen("db_compression=")) == 0) {
+      if (!parse_bool(buf + strlen("db_compression="), &db_compression_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE:%s compressing packets in the DB\n", db_compression_ ? "" : " NOT");
+    } else if (strncmp(buf, "db_compression_level=", strlen("db_compression_level=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("db_compression_level="), &value) || value < 1 || value > 9) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        db_compression_level_ = value;
+        fprintf(stderr, "NOTICE: compressing packets in the DB at level %d\n", db_compression_level_);
+      }
+    } else if (strncmp(buf, "db_dict_bytes=", strlen("db_dict_bytes=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("db_dict_bytes="), &value) || value == 0 || value > 32768) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        db_dict_bytes_ = value;
+        fprintf(stderr, "NOTICE: training DB dictionaries of %u bytes\n", db_dict_bytes_);
+      }
+    } else if (strncmp(buf, "db_dict_sample_rows=", strlen("db_dict_sample_rows=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("db_dict_sample_rows="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        db_dict_sample_rows_ = value;
+        fprintf(stderr, "NOTICE: training DB dictionaries on %u rows\n", db_dict_sample_rows_);
+      }
+    } else if (strncmp(buf, "db_dict_max_age_sec=", strlen("db_dict_max_age_sec=")) == 0) {
+      if (!parse_uint32(buf + strlen("db_dict_max_age_sec="), &db_dict_max_age_sec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: retraining DB dictionaries after %u sec\n", db_dict_max_age_sec_);
+    } else if (strncmp(buf, "db_replay_on_start=", strlen("db_replay_on_start=")) == 0) {
+      if (!parse_bool(buf + strlen("db_replay_on_start="), &db_replay_on_start_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE:%s replaying the DB to ES on start\n", db_replay_on_start_ ? "" : " NOT");
+    } else if (strncmp(buf, "db_replay_max_rate=", strlen("db_replay_max_rate=")) == 0) {
+      if (!parse_uint32(buf + strlen("db_replay_max_rate="), &db_replay_max_rate_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: replaying the DB at up to %u rows/sec (0 means no limit)\n", db_replay_max_rate_);
     } else if (strncmp(buf, "send_to_es=", strlen("send_to_es=")) == 0) {
       if (!parse_bool(buf + strlen("send_to_es="), &send_packets_to_es_))
         fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
@@ -134,6 +506,244 @@ void Configurator::read_config_from_file(FILE *fp) {
         fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
       else
         fprintf(stderr, "NOTICE:%s forwarding detailed reports to ES\n", forward_detailed_reports_ ? "" : " NOT");
+    } else if (strncmp(buf, "udp_batch_size=", strlen("udp_batch_size=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("udp_batch_size="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        udp_batch_size_ = value;
+        fprintf(stderr, "NOTICE: receiving up to %u datagrams per syscall\n", udp_batch_size_);
+      }
+    } else if (strncmp(buf, "udp_listener_shards=", strlen("udp_listener_shards=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("udp_listener_shards="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        udp_listener_shards_ = value;
+        fprintf(stderr, "NOTICE: using %u UDP listener shards\n", udp_listener_shards_);
+      }
+    } else if (strncmp(buf, "msg_pool_size=", strlen("msg_pool_size=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("msg_pool_size="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        msg_pool_size_ = value;
+        fprintf(stderr, "NOTICE: using %u message buffers per listener shard\n", msg_pool_size_);
+      }
+    } else if (strncmp(buf, "dispatch_batch_size=", strlen("dispatch_batch_size=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("dispatch_batch_size="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        dispatch_batch_size_ = value;
+        fprintf(stderr, "NOTICE: dispatching up to %u messages per batch\n", dispatch_batch_size_);
+      }
+    } else if (strncmp(buf, "dispatch_batch_wait_usec=", strlen("dispatch_batch_wait_usec=")) == 0) {
+      if (!parse_uint32(buf + strlen("dispatch_batch_wait_usec="), &dispatch_batch_wait_usec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: waiting up to %u usec to fill a dispatch batch\n", dispatch_batch_wait_usec_);
+    } else if (strncmp(buf, "inbound_high_watermark_bytes=", strlen("inbound_high_watermark_bytes=")) == 0) {
+      uint64_t value;
+      if (!parse_uint64(buf + strlen("inbound_high_watermark_bytes="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        inbound_high_watermark_bytes_ = value;
+        fprintf(stderr, "NOTICE: start dropping inbound messages above %" PRIu64 " queued bytes\n",
+                inbound_high_watermark_bytes_);
+      }
+    } else if (strncmp(buf, "inbound_low_watermark_bytes=", strlen("inbound_low_watermark_bytes=")) == 0) {
+      if (!parse_uint64(buf + strlen("inbound_low_watermark_bytes="), &inbound_low_watermark_bytes_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: stop dropping inbound messages below %" PRIu64 " queued bytes\n",
+                inbound_low_watermark_bytes_);
+    } else if (strncmp(buf, "filter_report_types=", strlen("filter_report_types=")) == 0) {
+      std::vector<std::string> types;
+      bool valid = parse_string_list(buf + strlen("filter_report_types="), &types);
+      bool drop_summary = false;
+      bool drop_detailed = false;
+      for (const std::string &type : types) {
+        if (type == "summary")
+          drop_summary = true;
+        else if (type == "detailed")
+          drop_detailed = true;
+        else
+          valid = false;
+      }
+      if (!valid) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        filter_.drop_summary = drop_summary;
+        filter_.drop_detailed = drop_detailed;
+        fprintf(stderr, "NOTICE: discarding%s%s reports on receipt\n",
+                drop_summary ? " summary" : "", drop_detailed ? " detailed" : "");
+      }
+    } else if (strncmp(buf, "filter_modules=", strlen("filter_modules=")) == 0) {
+      if (!parse_string_list(buf + strlen("filter_modules="), &filter_.modules))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: discarding reports from %zu module(s) on receipt\n", filter_.modules.size());
+    } else if (strncmp(buf, "filter_pgnames=", strlen("filter_pgnames=")) == 0) {
+      if (!parse_string_list(buf + strlen("filter_pgnames="), &filter_.pgnames))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: discarding reports from %zu pgname(s) on receipt\n", filter_.pgnames.size());
+    } else if (strncmp(buf, "es_bulk_max_bytes=", strlen("es_bulk_max_bytes=")) == 0) {
+      uint64_t value;
+      if (!parse_uint64(buf + strlen("es_bulk_max_bytes="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_bulk_max_bytes_ = value;
+        fprintf(stderr, "NOTICE: flushing ES bulk requests at %" PRIu64 " bytes\n", es_bulk_max_bytes_);
+      }
+    } else if (strncmp(buf, "es_bulk_max_docs=", strlen("es_bulk_max_docs=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_bulk_max_docs="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_bulk_max_docs_ = value;
+        fprintf(stderr, "NOTICE: flushing ES bulk requests at %u documents\n", es_bulk_max_docs_);
+      }
+    } else if (strncmp(buf, "es_bulk_linger_msec=", strlen("es_bulk_linger_msec=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_bulk_linger_msec="), &es_bulk_linger_msec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: flushing ES bulk requests after %u msec\n", es_bulk_linger_msec_);
+    } else if (strncmp(buf, "es_bulk_max_retries=", strlen("es_bulk_max_retries=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_bulk_max_retries="), &es_bulk_max_retries_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: retrying failed ES bulk items up to %u times\n", es_bulk_max_retries_);
+    } else if (strncmp(buf, "es_max_inflight=", strlen("es_max_inflight=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_max_inflight="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_max_inflight_ = value;
+        fprintf(stderr, "NOTICE: keeping up to %u ES requests in flight\n", es_max_inflight_);
+      }
+    } else if (strncmp(buf, "es_bulk_timeout_msec=", strlen("es_bulk_timeout_msec=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_bulk_timeout_msec="), &es_bulk_timeout_msec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: timing out ES bulk requests after %u msec\n", es_bulk_timeout_msec_);
+    } else if (strncmp(buf, "es_adaptive=", strlen("es_adaptive=")) == 0) {
+      if (!parse_bool(buf + strlen("es_adaptive="), &es_adaptive_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE:%s adapting ES bulk sizes and concurrency\n", es_adaptive_ ? "" : " NOT");
+    } else if (strncmp(buf, "es_bulk_min_docs=", strlen("es_bulk_min_docs=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_bulk_min_docs="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_bulk_min_docs_ = value;
+        fprintf(stderr, "NOTICE: flushing adaptive ES bulk requests at %u documents at least\n", es_bulk_min_docs_);
+      }
+    } else if (strncmp(buf, "es_min_inflight=", strlen("es_min_inflight=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_min_inflight="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_min_inflight_ = value;
+        fprintf(stderr, "NOTICE: keeping at least %u adaptive ES requests in flight\n", es_min_inflight_);
+      }
+    } else if (strncmp(buf, "es_target_p99_msec=", strlen("es_target_p99_msec=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_target_p99_msec="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_target_p99_msec_ = value;
+        fprintf(stderr, "NOTICE: backing off when ES p99 latency exceeds %u msec\n", es_target_p99_msec_);
+      }
+    } else if (strncmp(buf, "es_spool_max_bytes=", strlen("es_spool_max_bytes=")) == 0) {
+      if (!parse_uint64(buf + strlen("es_spool_max_bytes="), &es_spool_max_bytes_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else if (!es_spool_max_bytes_)
+        fprintf(stderr, "NOTICE: ES spool disabled\n");
+      else
+        fprintf(stderr, "NOTICE: spooling up to %" PRIu64 " bytes of undelivered ES documents\n",
+                es_spool_max_bytes_);
+    } else if (strncmp(buf, "es_spool_segment_bytes=", strlen("es_spool_segment_bytes=")) == 0) {
+      uint64_t value;
+      if (!parse_uint64(buf + strlen("es_spool_segment_bytes="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_spool_segment_bytes_ = value;
+        fprintf(stderr, "NOTICE: using ES spool segments of %" PRIu64 " bytes\n", es_spool_segment_bytes_);
+      }
+    } else if (strncmp(buf, "es_balance=", strlen("es_balance=")) == 0) {
+      const char *value = buf + strlen("es_balance=");
+      if (strcmp(value, "round_robin") == 0) {
+        es_balance_least_outstanding_ = false;
+        fprintf(stderr, "NOTICE: spreading ES requests round-robin\n");
+      } else if (strcmp(value, "least_outstanding") == 0) {
+        es_balance_least_outstanding_ = true;
+        fprintf(stderr, "NOTICE: sending ES requests to the least busy node\n");
+      } else {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      }
+    } else if (strncmp(buf, "es_node_max_failures=", strlen("es_node_max_failures=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_node_max_failures="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_node_max_failures_ = value;
+        fprintf(stderr, "NOTICE: ejecting ES nodes after %u consecutive failures\n", es_node_max_failures_);
+      }
+    } else if (strncmp(buf, "es_node_eject_msec=", strlen("es_node_eject_msec=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_node_eject_msec="), &es_node_eject_msec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: ejecting failing ES nodes for %u msec\n", es_node_eject_msec_);
+    } else if (strncmp(buf, "es_accept_past_sec=", strlen("es_accept_past_sec=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_accept_past_sec="), &es_accept_past_sec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: accepting ES reports up to %u sec old\n", es_accept_past_sec_);
+    } else if (strncmp(buf, "es_accept_future_sec=", strlen("es_accept_future_sec=")) == 0) {
+      if (!parse_uint32(buf + strlen("es_accept_future_sec="), &es_accept_future_sec_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: accepting ES reports up to %u sec in the future\n", es_accept_future_sec_);
+    } else if (strncmp(buf, "es_gzip_level=", strlen("es_gzip_level=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_gzip_level="), &value) || value > 9) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_gzip_level_ = value;
+        if (!es_gzip_level_)
+          fprintf(stderr, "NOTICE: NOT compressing ES request bodies\n");
+        else
+          fprintf(stderr, "NOTICE: compressing ES request bodies with gzip level %u\n", es_gzip_level_);
+      }
+    } else if (strncmp(buf, "es_gzip_min_bytes=", strlen("es_gzip_min_bytes=")) == 0) {
+      if (!parse_uint64(buf + strlen("es_gzip_min_bytes="), &es_gzip_min_bytes_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE: compressing ES request bodies from %" PRIu64 " bytes\n", es_gzip_min_bytes_);
+    } else if (strncmp(buf, "es_trace_interning=", strlen("es_trace_interning=")) == 0) {
+      if (!parse_bool(buf + strlen("es_trace_interning="), &es_trace_interning_))
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      else
+        fprintf(stderr, "NOTICE:%s interning stack traces sent to ES\n", es_trace_interning_ ? "" : " NOT");
+    } else if (strncmp(buf, "es_trace_cache_size=", strlen("es_trace_cache_size=")) == 0) {
+      uint32_t value;
+      if (!parse_uint32(buf + strlen("es_trace_cache_size="), &value) || value == 0) {
+        fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+      } else {
+        es_trace_cache_size_ = value;
+        fprintf(stderr, "NOTICE: remembering up to %u interned stack traces\n", es_trace_cache_size_);
+      }
+    } else if (read_queue_config(buf, "summary_lane_", &summary_lane_)) {
+      // handled
+    } else if (read_queue_config(buf, "detailed_lane_", &detailed_lane_)) {
+      // handled
+    } else if (read_queue_config(buf, "db_queue_", &db_queue_)) {
+      // handled
+    } else if (read_queue_config(buf, "es_queue_", &es_queue_)) {
+      // handled
     }
 
   } // while (true)
@@ -141,6 +751,44 @@ void Configurator::read_config_from_file(FILE *fp) {
   free(buf);
 }
 
+bool Configurator::read_queue_config(const char *buf, const char *prefix, QueueConfig *queue) {
+  if (strncmp(buf, prefix, strlen(prefix)) != 0)
+    return false;
+
+  const char *key = buf + strlen(prefix);
+  if (strncmp(key, "high_watermark_bytes=", strlen("high_watermark_bytes=")) == 0) {
+    uint64_t value;
+    if (!parse_uint64(key + strlen("high_watermark_bytes="), &value) || value == 0) {
+      fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+    } else {
+      queue->high_watermark_bytes = value;
+      fprintf(stderr, "NOTICE: %s: start dropping above %" PRIu64 " queued bytes\n", prefix, value);
+    }
+  } else if (strncmp(key, "low_watermark_bytes=", strlen("low_watermark_bytes=")) == 0) {
+    if (!parse_uint64(key + strlen("low_watermark_bytes="), &queue->low_watermark_bytes))
+      fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+    else
+      fprintf(stderr, "NOTICE: %s: stop dropping below %" PRIu64 " queued bytes\n", prefix,
+              queue->low_watermark_bytes);
+  } else if (strncmp(key, "drop_policy=", strlen("drop_policy=")) == 0) {
+    const char *value = key + strlen("drop_policy=");
+    if (strcmp(value, "newest") == 0) {
+      queue->drop_oldest = false;
+      fprintf(stderr, "NOTICE: %s: dropping the newest messages when full\n", prefix);
+    } else if (strcmp(value, "oldest") == 0) {
+      queue->drop_oldest = true;
+      fprintf(stderr, "NOTICE: %s: dropping the oldest messages when full\n", prefix);
+    } else {
+      fprintf(stderr, "WARNING: failed to parse config line '%s'\n", buf);
+    }
+  } else {
+    // unknown setting for this queue, ignore it like any other line
+    return false;
+  }
+
+  return true;
+}
+
 bool Configurator::parse_string(const char *buf, std::string *output) {
   if (buf[0] == '\0')
     // empty string
@@ -150,6 +798,25 @@ bool Configurator::parse_string(const char *buf, std::string *output) {
   return true;
 }
 
+bool Configurator::parse_string_list(const char *buf, std::vector<std::string> *output) {
+  std::vector<std::string> items;
+  while (true) {
+    const char *comma = strchr(buf, ',');
+    const size_t len = comma ? (size_t) (comma - buf) : strlen(buf);
+    if (!len)
+      // empty item
+      return false;
+
+    items.push_back(std::string(buf, len));
+    if (!comma)
+      break;
+    buf = comma + 1;
+  }
+
+  output->swap(items);
+  return true;
+}
+
 bool Configurator::parse_bool(const char *buf, bool *output) {
   if (strlen(buf) == strlen("true") && strcmp(buf, "true") == 0) {
     *output = true;
@@ -165,5 +832,30 @@ bool Configurator::parse_bool(const char *buf, bool *output) {
   return false;
 }
 
+bool Configurator::parse_uint32(const char *buf, uint32_t *output) {
+  uint64_t value;
+  if (!parse_uint64(buf, &value) || value > UINT32_MAX)
+    return false;
+
+  *output = value;
+  return true;
+}
+
+bool Configurator::parse_uint64(const char *buf, uint64_t *output) {
+  if (buf[0] < '0' || buf[0] > '9')
+    // empty string, or a sign/space that strtoull would accept
+    return false;
+
+  char *endptr = NULL;
+  errno = 0;
+  const unsigned long long value = strtoull(buf, &endptr, 10);
+  if (errno || *endptr != '\0')
+    // trailing garbage, or out of range
+    return false;
+
+  *output = value;
+  return true;
+}
+
 } // namespace lib
 } // namespace freud
@@ -18,13 +18,32 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace freud {
 namespace lib {
 
 class Configurator {
  public:
+  // settings of one bounded message queue (an inbound priority lane,
+  // or the queue in front of a sink)
+  struct QueueConfig {
+    uint64_t high_watermark_bytes;
+    uint64_t low_watermark_bytes;
+    bool drop_oldest; // otherwise, tail-drop the newest message
+  };
+
+  // reports to discard as soon as they are received, before they are
+  // queued or parsed
+  struct FilterConfig {
+    bool drop_summary;
+    bool drop_detailed;
+    std::vector<std::string> modules;
+    std::vector<std::string> pgnames;
+  };
+
   // this constructor initializes the configuration using default values
   Configurator();
   // read config from argc/argv, or use defaults when not available
@@ -34,25 +53,132 @@ class Configurator {
 
   const std::string& get_database_directory() const;
   const std::string& get_portfile_filename() const;
-  const std::string& get_elastic_search_url() const;
+  const std::vector<std::string>& get_elastic_search_urls() const;
   const std::string& get_elastic_search_index() const;
   bool get_cache_packets_in_db() const;
+  const std::string& get_db_synchronous() const;
+  const std::string& get_db_journal_mode() const;
+  uint64_t get_db_journal_size_limit() const;
+  uint32_t get_db_commit_max_packets() const;
+  uint32_t get_db_commit_max_msec() const;
+  uint64_t get_db_max_rows() const;
+  uint64_t get_db_max_bytes() const;
+  uint32_t get_db_max_age_sec() const;
+  uint32_t get_db_eviction_batch_rows() const;
+  bool get_db_index_metadata() const;
+  bool get_db_compression() const;
+  int get_db_compression_level() const;
+  uint32_t get_db_dict_bytes() const;
+  uint32_t get_db_dict_sample_rows() const;
+  uint32_t get_db_dict_max_age_sec() const;
+  bool get_db_replay_on_start() const;
+  uint32_t get_db_replay_max_rate() const;
   bool get_send_packets_to_es() const;
   bool fwd_detailed_reports() const;
+  uint32_t get_udp_batch_size() const;
+  uint32_t get_udp_listener_shards() const;
+  uint32_t get_msg_pool_size() const;
+  uint32_t get_dispatch_batch_size() const;
+  uint32_t get_dispatch_batch_wait_usec() const;
+  uint64_t get_inbound_high_watermark_bytes() const;
+  uint64_t get_inbound_low_watermark_bytes() const;
+  const QueueConfig& get_summary_lane() const;
+  const QueueConfig& get_detailed_lane() const;
+  const QueueConfig& get_db_queue() const;
+  const QueueConfig& get_es_queue() const;
+  const FilterConfig& get_filter() const;
+  uint64_t get_es_bulk_max_bytes() const;
+  uint32_t get_es_bulk_max_docs() const;
+  uint32_t get_es_bulk_linger_msec() const;
+  uint32_t get_es_bulk_max_retries() const;
+  uint32_t get_es_max_inflight() const;
+  uint32_t get_es_bulk_timeout_msec() const;
+  bool get_es_adaptive() const;
+  uint32_t get_es_bulk_min_docs() const;
+  uint32_t get_es_min_inflight() const;
+  uint32_t get_es_target_p99_msec() const;
+  uint64_t get_es_spool_max_bytes() const;
+  uint64_t get_es_spool_segment_bytes() const;
+  bool get_es_balance_least_outstanding() const;
+  uint32_t get_es_node_max_failures() const;
+  uint32_t get_es_node_eject_msec() const;
+  uint32_t get_es_accept_past_sec() const;
+  uint32_t get_es_accept_future_sec() const;
+  uint32_t get_es_gzip_level() const;
+  uint64_t get_es_gzip_min_bytes() const;
+  bool get_es_trace_interning() const;
+  uint32_t get_es_trace_cache_size() const;
 
  private:
   std::string database_directory_;
   std::string portfile_filename_;
-  std::string elastic_search_url_;
+  std::vector<std::string> elastic_search_urls_;
   std::string elastic_search_index_;
 
   bool cache_packets_in_db_;
+  std::string db_synchronous_;
+  std::string db_journal_mode_;
+  uint64_t db_journal_size_limit_;
+  uint32_t db_commit_max_packets_;
+  uint32_t db_commit_max_msec_;
+  uint64_t db_max_rows_;
+  uint64_t db_max_bytes_;
+  uint32_t db_max_age_sec_;
+  uint32_t db_eviction_batch_rows_;
+  bool db_index_metadata_;
+  bool db_compression_;
+  int db_compression_level_;
+  uint32_t db_dict_bytes_;
+  uint32_t db_dict_sample_rows_;
+  uint32_t db_dict_max_age_sec_;
+  bool db_replay_on_start_;
+  uint32_t db_replay_max_rate_;
   bool send_packets_to_es_;
   bool forward_detailed_reports_;
 
+  uint32_t udp_batch_size_;
+  uint32_t udp_listener_shards_;
+  uint32_t msg_pool_size_;
+  uint32_t dispatch_batch_size_;
+  uint32_t dispatch_batch_wait_usec_;
+  uint64_t inbound_high_watermark_bytes_;
+  uint64_t inbound_low_watermark_bytes_;
+  QueueConfig summary_lane_;
+  QueueConfig detailed_lane_;
+  QueueConfig db_queue_;
+  QueueConfig es_queue_;
+  FilterConfig filter_;
+  uint64_t es_bulk_max_bytes_;
+  uint32_t es_bulk_max_docs_;
+  uint32_t es_bulk_linger_msec_;
+  uint32_t es_bulk_max_retries_;
+  uint32_t es_max_inflight_;
+  uint32_t es_bulk_timeout_msec_; // 0 means no timeout
+  bool es_adaptive_;
+  uint32_t es_bulk_min_docs_;
+  uint32_t es_min_inflight_;
+  uint32_t es_target_p99_msec_;
+  uint64_t es_spool_max_bytes_;
+  uint64_t es_spool_segment_bytes_;
+  bool es_balance_least_outstanding_; // otherwise, round-robin
+  uint32_t es_node_max_failures_;
+  uint32_t es_node_eject_msec_;
+  uint32_t es_accept_past_sec_;
+  uint32_t es_accept_future_sec_;
+  uint32_t es_gzip_level_; // 0 disables compression
+  uint64_t es_gzip_min_bytes_;
+  bool es_trace_interning_;
+  uint32_t es_trace_cache_size_;
+
   void read_config_from_file(FILE *fp);
+  // returns true if buf is a setting for the queue with that prefix
+  static bool read_queue_config(const char *buf, const char *prefix, QueueConfig *queue);
   static bool parse_string(const char *buf, std::string *output);
+  // comma-separated, non-empty items
+  static bool parse_string_list(const char *buf, std::vector<std::string> *output);
   static bool parse_bool(const char *buf, bool *output);
+  static bool parse_uint32(const char *buf, uint32_t *output);
+  static bool parse_uint64(const char *buf, uint64_t *output);
 };
 
 } // namespace lib
@@ -0,0 +1,292 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/db_codec.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// length of the byte sequences counted while training dictionaries
+#define DB_DICT_SHINGLE_BYTES 8
+
+namespace freud {
+namespace lib {
+
+DBCodec::DBCodec(const int level)
+    : level_(level), version_(0), primed_init_(false), deflate_init_(false), inflate_init_(false) {
+  memset(&primed_, 0, sizeof(primed_));
+  memset(&deflate_, 0, sizeof(deflate_));
+  memset(&inflate_, 0, sizeof(inflate_));
+}
+
+DBCodec::~DBCodec() {
+  end_deflate();
+  if (inflate_init_)
+    inflateEnd(&inflate_);
+}
+
+bool DBCodec::load(sqlite3 *db_handle, time_t *created_ts) {
+  *created_ts = 0;
+
+  sqlite3_stmt *stmt = NULL;
+  if (sqlite3_prepare_v2(db_handle, "SELECT version, created_ts, data FROM dicts ORDER BY version;", -1, &stmt,
+                         NULL) != SQLITE_OK) {
+    fprintf(stderr, "ERROR: %s, prepare failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle));
+    return false;
+  }
+
+  int res;
+  int64_t latest = 0;
+  while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+    latest = sqlite3_column_int64(stmt, 0);
+    *created_ts = sqlite3_column_int64(stmt, 1);
+    dicts_[latest].assign(static_cast<const char*>(sqlite3_column_blob(stmt, 2)), sqlite3_column_bytes(stmt, 2));
+  }
+  sqlite3_finalize(stmt);
+
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "ERROR: %s, reading dictionaries failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle));
+    return false;
+  }
+
+  return !latest || select(latest);
+}
+
+bool DBCodec::load(sqlite3 *db_handle, const int64_t version) {
+  if (dicts_.count(version))
+    return true;
+
+  sqlite3_stmt *stmt = NULL;
+  if (sqlite3_prepare_v2(db_handle, "SELECT data FROM dicts WHERE version = @version;", -1, &stmt,
+                         NULL) != SQLITE_OK) {
+    fprintf(stderr, "ERROR: %s, prepare failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle));
+    return false;
+  }
+
+  sqlite3_bind_int64(stmt, 1, version);
+  const bool found = sqlite3_step(stmt) == SQLITE_ROW;
+  if (found)
+    dicts_[version].assign(static_cast<const char*>(sqlite3_column_blob(stmt, 0)), sqlite3_column_bytes(stmt, 0));
+  else
+    fprintf(stderr, "ERROR: %s, dictionary v%" PRId64 " not found: %s\n", __FUNCTION__, version,
+            sqlite3_errmsg(db_handle));
+  sqlite3_finalize(stmt);
+  return found;
+}
+
+bool DBCodec::train(sqlite3 *db_handle, const std::vector<std::string> &samples, const size_t max_bytes,
+                    const time_t now) {
+  std::string dict;
+  build_dictionary(samples, std::min<size_t>(max_bytes, DB_DICT_MAX_BYTES), &dict);
+  if (dict.size() < DB_DICT_SHINGLE_BYTES) {
+    fprintf(stderr, "WARNING: %s, %zu samples share too little to train a dictionary\n", __FUNCTION__,
+            samples.size());
+    return false;
+  }
+
+  sqlite3_stmt *stmt = NULL;
+  if (sqlite3_prepare_v2(db_handle, "INSERT INTO dicts (created_ts, data) VALUES (@ts, @data);", -1, &stmt,
+                         NULL) != SQLITE_OK) {
+    fprintf(stderr, "ERROR: %s, prepare failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle));
+    return false;
+  }
+
+  sqlite3_bind_int64(stmt, 1, now);
+  sqlite3_bind_blob(stmt, 2, dict.data(), dict.size(), SQLITE_STATIC);
+  const int res = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "ERROR: %s, storing the dictionary failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle));
+    return false;
+  }
+
+  const int64_t version = sqlite3_last_insert_rowid(db_handle);
+  dicts_[version].swap(dict);
+  fprintf(stderr, "INFO: trained DB dictionary v%" PRId64 " of %zu bytes on %zu samples\n", version,
+          dicts_[version].size(), samples.size());
+  return select(version);
+}
+
+bool DBCodec::compress(const char *data, const size_t len, std::string *out) {
+  if (!version_)
+    return false;
+
+  if (deflate_init_) {
+    deflateEnd(&deflate_);
+    deflate_init_ = false;
+  }
+  if (deflateCopy(&deflate_, &primed_) != Z_OK)
+    return false;
+  deflate_init_ = true;
+
+  // not worth storing unless it is smaller
+  out->resize(len);
+  deflate_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  deflate_.avail_in = len;
+  deflate_.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+  deflate_.avail_out = out->size();
+  if (deflate(&deflate_, Z_FINISH) != Z_STREAM_END)
+    return false;
+
+  out->resize(out->size() - deflate_.avail_out);
+  return true;
+}
+
+ssize_t DBCodec::decompress(const int64_t version, const void *data, const size_t len, char *out,
+                            const size_t capacity) {
+  const auto it = dicts_.find(version);
+  if (it == dicts_.end())
+    return -1;
+
+  if (!inflate_init_) {
+    if (inflateInit2(&inflate_, -15) != Z_OK)
+      return -1;
+    inflate_init_ = true;
+  } else if (inflateReset(&inflate_) != Z_OK) {
+    return -1;
+  }
+
+  // raw streams take their dictionary upfront
+  if (inflateSetDictionary(&inflate_, reinterpret_cast<const Bytef*>(it->second.data()), it->second.size()) != Z_OK)
+    return -1;
+
+  inflate_.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+  inflate_.avail_in = len;
+  inflate_.next_out = reinterpret_cast<Bytef*>(out);
+  inflate_.avail_out = capacity;
+  if (inflate(&inflate_, Z_FINISH) != Z_STREAM_END)
+    return -1;
+
+  return capacity - inflate_.avail_out;
+}
+
+bool DBCodec::select(const int64_t version) {
+  end_deflate();
+
+  // the smallest window that holds the whole dictionary
+  const std::string &dict = dicts_.at(version);
+  int window_bits = 9;
+  while (window_bits < 15 && (1U << window_bits) < dict.size())
+    ++window_bits;
+
+  // packets are small, so are the hash tables needed for them; this
+  // also makes copying the primed stream cheaper
+  if (deflateInit2(&primed_, level_, Z_DEFLATED, -window_bits, 4, Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "ERROR: %s, deflateInit2 failed\n", __FUNCTION__);
+    return false;
+  }
+  primed_init_ = true;
+
+  if (deflateSetDictionary(&primed_, reinterpret_cast<const Bytef*>(dict.data()), dict.size()) != Z_OK) {
+    fprintf(stderr, "ERROR: %s, deflateSetDictionary failed\n", __FUNCTION__);
+    end_deflate();
+    return false;
+  }
+
+  version_ = version;
+  return true;
+}
+
+void DBCodec::end_deflate() {
+  if (deflate_init_)
+    deflateEnd(&deflate_);
+  if (primed_init_)
+    deflateEnd(&primed_);
+  deflate_init_ = false;
+  primed_init_ = false;
+  version_ = 0;
+}
+
+void DBCodec::build_dictionary(const std::vector<std::string> &samples, const size_t max_bytes,
+                               std::string *dict) {
+  // the distinct sequences of each distinct sample, by dense id, and in
+  // how many samples each sequence appears
+  std::unordered_set<std::string> distinct;
+  std::vector<const std::string*> candidates;
+  std::vector<std::vector<uint32_t>> shingles;
+  std::unordered_map<uint64_t, uint32_t> ids;
+  std::vector<uint32_t> freq;
+  for (const std::string &sample : samples) {
+    if (sample.size() < DB_DICT_SHINGLE_BYTES || !distinct.insert(sample).second)
+      continue;
+
+    std::vector<uint32_t> list;
+    for (size_t i = 0; i + DB_DICT_SHINGLE_BYTES <= sample.size(); ++i) {
+      uint64_t shingle;
+      memcpy(&shingle, sample.data() + i, sizeof(shingle));
+      const auto it = ids.emplace(shingle, freq.size()).first;
+      if (it->second == freq.size())
+        freq.push_back(0);
+      list.push_back(it->second);
+    }
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    for (const uint32_t id : list)
+      ++freq[id];
+
+    candidates.push_back(&sample);
+    shingles.push_back(std::move(list));
+  }
+
+  // greedily take the sample whose sequences, not covered yet, appear
+  // in the most other samples, per byte
+  std::vector<const std::string*> picked;
+  std::vector<bool> used(candidates.size(), false);
+  size_t total = 0;
+  while (total < max_bytes) {
+    ssize_t best = -1;
+    double best_score = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      if (used[i])
+        continue;
+
+      uint64_t gain = 0;
+      for (const uint32_t id : shingles[i])
+        gain += freq[id] - 1;
+      const double score = (double) gain / candidates[i]->size();
+      if (score > best_score) {
+        best = i;
+        best_score = score;
+      }
+    }
+    if (best < 0)
+      break;
+
+    used[best] = true;
+    picked.push_back(candidates[best]);
+    total += candidates[best]->size();
+    // covered now
+    for (const uint32_t id : shingles[best])
+      freq[id] = 1;
+  }
+
+  // deflate encodes short distances in fewer bits, so the most useful
+  // samples go last, closest to the data
+  dict->clear();
+  for (auto it = picked.rbegin(); it != picked.rend(); ++it)
+    dict->append(**it);
+  if (dict->size() > max_bytes)
+    dict->erase(0, dict->size() - max_bytes);
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,100 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include <zlib.h>
+
+// dictionaries are at most as large as the largest deflate window
+#define DB_DICT_MAX_BYTES 32768
+
+namespace freud {
+namespace lib {
+
+// Compresses packets cached in the DB one by one, with raw deflate
+// primed with a preset dictionary: reports are too small to compress
+// on their own, but they share most of their strings with earlier
+// reports. Dictionaries are trained on a sample of cached packets, and
+// stored in the dicts table by version, so that rows compressed with
+// an older dictionary can still be decompressed. Not thread-safe.
+class DBCodec {
+ public:
+  // stored in the codec column of each row
+  enum Codec {
+    CODEC_RAW = 0,
+    CODEC_DEFLATE = 1,
+  };
+
+  explicit DBCodec(const int level);
+  ~DBCodec();
+
+  // load all dictionaries stored in the database, and select the most
+  // recent one for compression; created_ts gets its creation time, or 0
+  // if there is none
+  bool load(sqlite3 *db_handle, time_t *created_ts);
+  // load a single dictionary, unless it is known already
+  bool load(sqlite3 *db_handle, const int64_t version);
+  // train a new dictionary on samples, store it, and select it for
+  // compression
+  bool train(sqlite3 *db_handle, const std::vector<std::string> &samples, const size_t max_bytes,
+             const time_t now);
+
+  // version of the dictionary used by compress(), 0 if none
+  int64_t get_version() const { return version_; }
+  size_t get_dictionary_size() const { return version_ ? dicts_.at(version_).size() : 0; }
+
+  // returns false if there is no dictionary yet, or data does not
+  // compress; out is reused across calls
+  bool compress(const char *data, const size_t len, std::string *out);
+  // returns the size of the decompressed data, or -1 if it could not
+  // be decompressed into capacity bytes
+  ssize_t decompress(const int64_t version, const void *data, const size_t len, char *out, const size_t capacity);
+
+ private:
+  const int level_;
+  std::map<int64_t, std::string> dicts_;
+  int64_t version_;
+
+  // primed with the dictionary once, then copied for every packet,
+  // which is much cheaper than setting the dictionary every time
+  z_stream primed_;
+  bool primed_init_;
+  z_stream deflate_;
+  bool deflate_init_;
+  z_stream inflate_;
+  bool inflate_init_;
+
+  bool select(const int64_t version);
+  void end_deflate();
+
+  // concatenate the samples that share the most 8-byte sequences with
+  // the other ones, until max_bytes, most useful last
+  static void build_dictionary(const std::vector<std::string> &samples, const size_t max_bytes,
+                               std::string *dict);
+};
+
+} // namespace lib
+} // namespace freud
@@ -18,12 +18,36 @@
 
 #include "lib/db_interface.h"
 
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h> // for usleep
+#include <algorithm>
+
 namespace freud {
 namespace lib {
 
 DBInterface::DBInterface(const Configurator &config)
-    : db_directory_(config.get_database_directory()), fini_called_(false),
-      db_handle_(NULL), insert_pkt_cache_(NULL) {
+    : db_directory_(config.get_database_directory()), synchronous_(config.get_db_synchronous()),
+      journal_mode_(config.get_db_journal_mode()),
+      journal_size_limit_(config.get_db_journal_size_limit()),
+      commit_max_packets_(config.get_db_commit_max_packets()),
+      commit_max_usec_(config.get_db_commit_max_msec() * 1000L),
+      max_rows_(config.get_db_max_rows()), max_bytes_(config.get_db_max_bytes()),
+      max_age_sec_(config.get_db_max_age_sec()), eviction_batch_rows_(config.get_db_eviction_batch_rows()),
+      index_metadata_(config.get_db_index_metadata()), compression_(config.get_db_compression()),
+      dict_bytes_(config.get_db_dict_bytes()), dict_sample_rows_(config.get_db_dict_sample_rows()),
+      dict_max_age_sec_(config.get_db_dict_max_age_sec()),
+      fini_called_(false), db_handle_(NULL), insert_pkt_cache_(NULL), begin_(NULL), commit_(NULL),
+      evict_(NULL), page_count_(NULL), freelist_count_(NULL),
+      in_transaction_(false), transaction_packets_(0), ts_transaction_begin_(0),
+      commits_(0), committed_packets_(0), lost_packets_(0), commit_retries_(0), write_usec_(0),
+      page_size_(0), incremental_vacuum_(false), ts_next_retention_(0), ts_next_age_check_(0), ts_rate_begin_(0),
+      evicted_at_rate_begin_(0), rows_(0), used_bytes_(0), evicted_rows_(0), eviction_batches_(0),
+      eviction_rate_(0), vacuumed_pages_(0), codec_(config.get_db_compression_level()), ts_next_training_(0),
+      dict_version_(0), dict_size_(0), compressed_rows_(0), uncompressed_rows_(0), raw_bytes_(0),
+      stored_bytes_(0) {
   db_filename_ = db_directory_ + "/sqlite.db";
 }
 
@@ -42,13 +66,65 @@ bool DBInterface::init() {
 
   fprintf(stderr, "INFO: DB init'd at %s\n", db_filename_.c_str());
 
+  // the DB replay writes to the database too
+  sqlite3_busy_timeout(db_handle_, DB_BUSY_TIMEOUT_MSEC);
+
+  // only takes effect on databases without tables yet; see below
+  if (!exec("PRAGMA auto_vacuum=INCREMENTAL;")) {
+    close_handle();
+    return false;
+  }
+
+  // readers do not block the writer in WAL mode, and commits only
+  // append to the log; the mode is persistent, but set it every time
+  // for databases created by older versions, or in another mode
+  char pragma[128];
+  snprintf(pragma, sizeof(pragma), "PRAGMA journal_mode=%s;", journal_mode_.c_str());
+  char journal_mode[16] = "";
+  res = sqlite3_exec(db_handle_, pragma,
+                     [](void *mode, int argc, char **argv, char **) -> int {
+                       if (argc > 0 && argv[0])
+                         snprintf(static_cast<char*>(mode), 16, "%s", argv[0]);
+                       return 0;
+                     },
+                     journal_mode, NULL);
+  if (res != SQLITE_OK || strcasecmp(journal_mode, journal_mode_.c_str()) != 0)
+    // soft error, any journal still works
+    fprintf(stderr, "WARNING: failed to switch %s to journal mode '%s', using '%s'\n",
+            db_filename_.c_str(), journal_mode_.c_str(), journal_mode);
+
+  snprintf(pragma, sizeof(pragma), "PRAGMA synchronous=%s;", synchronous_.c_str());
+  if (!exec(pragma)) {
+    close_handle();
+    return false;
+  }
+  snprintf(pragma, sizeof(pragma), "PRAGMA journal_size_limit=%" PRIu64 ";", journal_size_limit_);
+  if (!exec(pragma)) {
+    close_handle();
+    return false;
+  }
+
   // create tables if they do not exist
-  char *errmsg = NULL;
-  res = sqlite3_exec(db_handle_, "CREATE TABLE IF NOT EXISTS cache (id INTEGER PRIMARY KEY, data BLOB);",
-                     NULL, NULL, &errmsg);
-  if (res != SQLITE_OK) {
-    fprintf(stderr, "ERROR: sqlite3_exec %s: %s\n", sqlite3_errmsg(db_handle_), errmsg);
-    sqlite3_free(errmsg);
+  if (!exec("CREATE TABLE IF NOT EXISTS cache (id INTEGER PRIMARY KEY, data BLOB, cached_ts INTEGER,"
+            " usec_ts INTEGER, type INTEGER, pgname TEXT, procname TEXT, module_name TEXT, pid INTEGER,"
+            " codec INTEGER, dict_version INTEGER);") ||
+      !migrate() ||
+      !exec("CREATE TABLE IF NOT EXISTS dicts (version INTEGER PRIMARY KEY, created_ts INTEGER, data BLOB);")) {
+    close_handle();
+    return false;
+  }
+
+  // rows are inserted in id order, which is close enough to usec_ts
+  // order for the index to be appended to, rather than updated at
+  // random; it includes the id, and thus covers queries selecting rows
+  // by time. Queries by module and time filter the rows of the time
+  // range: a second index on (module_name, usec_ts), as older versions
+  // created, would exceed DB_INDEX_MAX_SLOWDOWN_PCT on its own. Building
+  // the index on an existing cache takes a while, but only once.
+  const bool indices_ok = exec("DROP INDEX IF EXISTS cache_module_name_usec_ts;") && (index_metadata_ ?
+      exec("CREATE INDEX IF NOT EXISTS cache_usec_ts ON cache (usec_ts);") :
+      exec("DROP INDEX IF EXISTS cache_usec_ts;"));
+  if (!indices_ok) {
     close_handle();
     return false;
   }
@@ -56,18 +132,72 @@ bool DBInterface::init() {
   fprintf(stderr, "INFO: tables init'd at %s\n", db_filename_.c_str());
 
   // init all prepared statements
-  res = sqlite3_prepare_v2(db_handle_,
-                           "INSERT INTO cache (data) VALUES (@pktdata);",
-                           -1,
-                           &insert_pkt_cache_,
-                           NULL);
-  if (res != SQLITE_OK) {
-    fprintf(stderr, "ERROR: prepared stmt 1 failed: %s\n", sqlite3_errmsg(db_handle_));
-    close_handle();
+  // rows are evicted oldest first, and only if they are older than
+  // @before (rows cached by older versions have no timestamp)
+  if (!prepare("INSERT INTO cache (data, cached_ts, usec_ts, type, pgname, procname, module_name, pid, codec,"
+               " dict_version) VALUES (@pktdata, @ts, @usec_ts, @type, @pgname, @procname, @module_name, @pid,"
+               " @codec, @dict_version);",
+               &insert_pkt_cache_) ||
+      !prepare("BEGIN;", &begin_) ||
+      !prepare("COMMIT;", &commit_) ||
+      !prepare("DELETE FROM cache WHERE id IN (SELECT id FROM cache ORDER BY id LIMIT @count)"
+               " AND IFNULL(cached_ts, 0) < @before;", &evict_) ||
+      !prepare("PRAGMA page_count;", &page_count_) ||
+      !prepare("PRAGMA freelist_count;", &freelist_count_)) {
+    fini();
     return false;
   }
 
   fprintf(stderr, "INFO: stmts init'd at %s\n", db_filename_.c_str());
+
+  sqlite3_stmt *stmt = NULL;
+  int64_t rows = -1;
+  if (prepare("SELECT COUNT(*) FROM cache;", &stmt))
+    rows = query_int64(stmt);
+  finalize(&stmt);
+  if (prepare("PRAGMA page_size;", &stmt))
+    page_size_ = query_int64(stmt);
+  finalize(&stmt);
+  if (rows < 0 || page_size_ <= 0) {
+    fini();
+    return false;
+  }
+  rows_ = rows;
+
+  // auto_vacuum can only be switched on by rebuilding the database,
+  // which is cheap only while it is empty
+  int64_t auto_vacuum = -1;
+  if (prepare("PRAGMA auto_vacuum;", &stmt))
+    auto_vacuum = query_int64(stmt);
+  finalize(&stmt);
+  if (auto_vacuum != 2 && rows == 0 && exec("VACUUM;")) {
+    if (prepare("PRAGMA auto_vacuum;", &stmt))
+      auto_vacuum = query_int64(stmt);
+    finalize(&stmt);
+  }
+  incremental_vacuum_ = auto_vacuum == 2;
+  if (!incremental_vacuum_)
+    // soft error, freed pages are still reused for new rows
+    fprintf(stderr, "WARNING: incremental vacuum is not enabled on %s, evicted rows will not shrink it;"
+            " run 'PRAGMA auto_vacuum=INCREMENTAL; VACUUM;' on it while the daemon is stopped\n",
+            db_filename_.c_str());
+
+  fprintf(stderr, "INFO: DB cache holds %" PRIu64 " rows\n", rows_.load());
+
+  // rows compressed earlier are decompressed by the replay, even if
+  // compression is off now
+  time_t dict_created_ts;
+  if (!codec_.load(db_handle_, &dict_created_ts)) {
+    fini();
+    return false;
+  }
+  if (codec_.get_version()) {
+    fprintf(stderr, "INFO: using DB dictionary v%" PRId64 " of %zu bytes\n", codec_.get_version(),
+            codec_.get_dictionary_size());
+    ts_next_training_ = dict_max_age_sec_ ? dict_created_ts + dict_max_age_sec_ : INT64_MAX;
+  }
+  dict_version_ = codec_.get_version();
+  dict_size_ = codec_.get_dictionary_size();
   return true;
 }
 
@@ -76,53 +206,429 @@ void DBInterface::fini() {
     return;
   fini_called_ = true;
 
-  // finalize all prepared statements
-  if (insert_pkt_cache_) {
-    int res = sqlite3_finalize(insert_pkt_cache_);
-    if (res != SQLITE_OK)
-      // soft error
-      fprintf(stderr, "WARNING: %s, finalize stmt 1 failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+  if (db_handle_)
+    (void) commit();
 
-    insert_pkt_cache_ = NULL;
-  }
+  // finalize all prepared statements
+  finalize(&insert_pkt_cache_);
+  finalize(&begin_);
+  finalize(&commit_);
+  finalize(&evict_);
+  finalize(&page_count_);
+  finalize(&freelist_count_);
 
   close_handle();
   fprintf(stderr, "INFO: DB closed at %s\n", db_filename_.c_str());
 }
 
-bool DBInterface::cache_packet(const std::string &s) {
+bool DBInterface::cache_packet(const MsgBuffer &msg, const time_t now) {
+  if (!in_transaction_ && !begin())
+    return false;
+
   int res = sqlite3_reset(insert_pkt_cache_);
   if (res != SQLITE_OK)
     // soft error
     fprintf(stderr, "WARNING: %s, reset failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
 
+  const bool compressed = compression_ && codec_.compress(msg.data(), msg.size(), &compressed_);
+  const char *data = compressed ? compressed_.data() : msg.data();
+  const size_t len = compressed ? compressed_.size() : msg.size();
+
   // I am not going to call sqlite3_clear_bindings(), since we are
   // going to overwrite @pktdata anyway
   res = sqlite3_bind_blob(insert_pkt_cache_,
                           1,
-                          s.data(), s.length(),
+                          data, len,
                           SQLITE_STATIC);
+  if (res == SQLITE_OK)
+    res = sqlite3_bind_int(insert_pkt_cache_, 9, compressed ? DBCodec::CODEC_DEFLATE : DBCodec::CODEC_RAW);
+  if (res == SQLITE_OK)
+    res = compressed ? sqlite3_bind_int64(insert_pkt_cache_, 10, codec_.get_version()) :
+        sqlite3_bind_null(insert_pkt_cache_, 10);
   if (res != SQLITE_OK) {
     // fatal error
     fprintf(stderr, "ERROR: %s, bind failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
     return false;
   }
+  res = sqlite3_bind_int64(insert_pkt_cache_, 2, now);
+  if (res != SQLITE_OK || !bind_metadata(msg.decoded())) {
+    // fatal error
+    fprintf(stderr, "ERROR: %s, bind failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+    return false;
+  }
 
   res = sqlite3_step(insert_pkt_cache_);
   if (res != SQLITE_DONE) {
     // fatal error
     fprintf(stderr, "ERROR: %s, step failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+    if (sqlite3_get_autocommit(db_handle_)) {
+      // some errors (e.g. SQLITE_FULL) roll the whole transaction back
+      lost_packets_.fetch_add(transaction_packets_, std::memory_order_relaxed);
+      in_transaction_ = false;
+      transaction_packets_ = 0;
+    }
+    return false;
+  }
+
+  ++transaction_packets_;
+  (compressed ? compressed_rows_ : uncompressed_rows_).fetch_add(1, std::memory_order_relaxed);
+  raw_bytes_.fetch_add(msg.size(), std::memory_order_relaxed);
+  stored_bytes_.fetch_add(len, std::memory_order_relaxed);
+  return true;
+}
+
+size_t DBInterface::cache_packets(MsgBuffer *const *msgs, const size_t count) {
+  const int64_t ts_begin = get_monotonic_usec();
+  const time_t now = time(NULL);
+  size_t cached = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (cache_packet(*msgs[i], now))
+      ++cached;
+
+  if (in_transaction_ && transaction_packets_ >= commit_max_packets_)
+    (void) commit();
+
+  write_usec_.fetch_add(get_monotonic_usec() - ts_begin, std::memory_order_relaxed);
+  return cached;
+}
+
+bool DBInterface::commit() {
+  if (!in_transaction_)
+    return true;
+
+  const int64_t ts_begin = get_monotonic_usec();
+  in_transaction_ = false;
+  int res;
+  for (int attempt = 0;; ++attempt) {
+    sqlite3_reset(commit_);
+    res = sqlite3_step(commit_);
+    // a COMMIT that fails with SQLITE_BUSY leaves the transaction open
+    // and can be tried again, even after the busy handler gave up
+    if ((res & 0xff) != SQLITE_BUSY || attempt >= DB_COMMIT_RETRIES || sqlite3_get_autocommit(db_handle_))
+      break;
+    fprintf(stderr, "WARNING: %s, database busy, retrying commit of %u packet(s)\n", __FUNCTION__,
+            transaction_packets_);
+    commit_retries_.fetch_add(1, std::memory_order_relaxed);
+    usleep(DB_COMMIT_RETRY_USEC);
+  }
+  if (res != SQLITE_DONE) {
+    fprintf(stderr, "ERROR: %s, commit of %u packet(s) failed: %s\n", __FUNCTION__, transaction_packets_,
+            sqlite3_errmsg(db_handle_));
+    if (!sqlite3_get_autocommit(db_handle_))
+      (void) exec("ROLLBACK;");
+    lost_packets_.fetch_add(transaction_packets_, std::memory_order_relaxed);
+    transaction_packets_ = 0;
     return false;
   }
 
+  commits_.fetch_add(1, std::memory_order_relaxed);
+  committed_packets_.fetch_add(transaction_packets_, std::memory_order_relaxed);
+  rows_.fetch_add(transaction_packets_, std::memory_order_relaxed);
+  transaction_packets_ = 0;
+  write_usec_.fetch_add(get_monotonic_usec() - ts_begin, std::memory_order_relaxed);
   return true;
 }
 
+int64_t DBInterface::tick(const bool /*idle*/) {
+  if (!db_handle_)
+    return -1;
+
+  const int64_t now = get_monotonic_usec();
+  if (in_transaction_ && now - ts_transaction_begin_ >= commit_max_usec_)
+    (void) commit();
+
+  // maintenance waits for the open group to be committed, rather than
+  // cutting it short; the commit deadline bounds the delay
+  if (!in_transaction_ && now >= ts_next_retention_) {
+    // keep evicting, between batches of new packets, until the cache is
+    // back within its limits
+    maintain_dictionary();
+    const bool more = enforce_retention();
+    ts_next_retention_ = now + (more ? 0 : DB_RETENTION_CHECK_USEC);
+  }
+
+  int64_t next_usec = ts_next_retention_ > now ? ts_next_retention_ - now : 0;
+  if (in_transaction_) {
+    // due maintenance, too, waits for the commit deadline
+    const int64_t commit_usec = ts_transaction_begin_ + commit_max_usec_ - now;
+    if (!next_usec || commit_usec < next_usec)
+      next_usec = commit_usec;
+  }
+  return next_usec;
+}
+
+void DBInterface::dump_stats(FILE *fp) const {
+  const uint64_t packets = committed_packets_.load();
+  const uint64_t commits = commits_.load();
+  const uint64_t usec = write_usec_.load();
+  fprintf(fp, "STATS: DB: %" PRIu64 " packets committed in %" PRIu64 " transactions (%.1f per commit), %" PRIu64
+          " packets lost, %" PRIu64 " commits retried, %" PRIu64 " usec writing (%.0f packets/sec)\n",
+          packets, commits, commits ? (double) packets / commits : 0.0, lost_packets_.load(),
+          commit_retries_.load(), usec, usec ? packets * 1e6 / usec : 0.0);
+  fprintf(fp, "STATS: DB retention: %" PRIu64 " rows, %" PRIu64 " bytes, %" PRIu64 " rows evicted in %" PRIu64
+          " batches (%" PRIu64 " rows/sec), %" PRIu64 " pages vacuumed\n",
+          rows_.load(), used_bytes_.load(), evicted_rows_.load(), eviction_batches_.load(), eviction_rate_.load(),
+          vacuumed_pages_.load());
+  const uint64_t raw_bytes = raw_bytes_.load();
+  const uint64_t stored_bytes = stored_bytes_.load();
+  fprintf(fp, "STATS: DB compression: dictionary v%" PRId64 " of %" PRIu64 " bytes, %" PRIu64 " rows compressed, %"
+          PRIu64 " rows stored as is, %" PRIu64 " bytes stored for %" PRIu64 " bytes cached (%.2fx)\n",
+          dict_version_.load(), dict_size_.load(), compressed_rows_.load(), uncompressed_rows_.load(),
+          stored_bytes, raw_bytes, stored_bytes ? (double) raw_bytes / stored_bytes : 1.0);
+}
+
+bool DBInterface::begin() {
+  sqlite3_reset(begin_);
+  if (sqlite3_step(begin_) != SQLITE_DONE) {
+    fprintf(stderr, "ERROR: %s failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+    return false;
+  }
+
+  in_transaction_ = true;
+  transaction_packets_ = 0;
+  ts_transaction_begin_ = get_monotonic_usec();
+  return true;
+}
+
+bool DBInterface::exec(const char *sql) {
+  char *errmsg = NULL;
+  const int res = sqlite3_exec(db_handle_, sql, NULL, NULL, &errmsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "ERROR: sqlite3_exec '%s': %s\n", sql, errmsg ? errmsg : sqlite3_errmsg(db_handle_));
+    sqlite3_free(errmsg);
+    return false;
+  }
+  return true;
+}
+
+bool DBInterface::prepare(const char *sql, sqlite3_stmt **stmt) {
+  const int res = sqlite3_prepare_v2(db_handle_, sql, -1, stmt, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "ERROR: prepared stmt '%s' failed: %s\n", sql, sqlite3_errmsg(db_handle_));
+    return false;
+  }
+  return true;
+}
+
+int64_t DBInterface::query_int64(sqlite3_stmt *stmt) {
+  sqlite3_reset(stmt);
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    fprintf(stderr, "ERROR: %s '%s' failed: %s\n", __FUNCTION__, sqlite3_sql(stmt), sqlite3_errmsg(db_handle_));
+    return -1;
+  }
+
+  const int64_t value = sqlite3_column_int64(stmt, 0);
+  sqlite3_reset(stmt);
+  return value;
+}
+
+bool DBInterface::migrate() {
+  // in the order they were introduced; rows cached before a column was
+  // added have it NULL
+  static const char *const columns[][2] = {
+    { "cached_ts", "INTEGER" },
+    { "usec_ts", "INTEGER" },
+    { "type", "INTEGER" },
+    { "pgname", "TEXT" },
+    { "procname", "TEXT" },
+    { "module_name", "TEXT" },
+    { "pid", "INTEGER" },
+    { "codec", "INTEGER" },
+    { "dict_version", "INTEGER" },
+  };
+
+  char sql[128];
+  for (const auto &column : columns) {
+    sqlite3_stmt *stmt = NULL;
+    snprintf(sql, sizeof(sql), "SELECT %s FROM cache LIMIT 0;", column[0]);
+    if (sqlite3_prepare_v2(db_handle_, sql, -1, &stmt, NULL) == SQLITE_OK) {
+      finalize(&stmt);
+      continue;
+    }
+
+    fprintf(stderr, "NOTICE: adding column %s to the cache table in %s\n", column[0], db_filename_.c_str());
+    snprintf(sql, sizeof(sql), "ALTER TABLE cache ADD COLUMN %s %s;", column[0], column[1]);
+    if (!exec(sql))
+      return false;
+  }
+
+  return true;
+}
+
+bool DBInterface::bind_metadata(const DecodedReport *report) {
+  if (!report) {
+    for (int i = 3; i <= 8; ++i)
+      if (sqlite3_bind_null(insert_pkt_cache_, i) != SQLITE_OK)
+        return false;
+    return true;
+  }
+
+  // the report outlives the insert, no need to copy its strings
+  const freudpb::Report &pb = report->get_report();
+  return sqlite3_bind_int64(insert_pkt_cache_, 3, pb.usec_ts()) == SQLITE_OK &&
+      sqlite3_bind_int(insert_pkt_cache_, 4, pb.type()) == SQLITE_OK &&
+      sqlite3_bind_text(insert_pkt_cache_, 5, pb.pgname().data(), pb.pgname().size(), SQLITE_STATIC) == SQLITE_OK &&
+      sqlite3_bind_text(insert_pkt_cache_, 6, pb.procname().data(), pb.procname().size(),
+                        SQLITE_STATIC) == SQLITE_OK &&
+      sqlite3_bind_text(insert_pkt_cache_, 7, pb.module_name().data(), pb.module_name().size(),
+                        SQLITE_STATIC) == SQLITE_OK &&
+      sqlite3_bind_int(insert_pkt_cache_, 8, pb.pid()) == SQLITE_OK;
+}
+
+bool DBInterface::enforce_retention() {
+  const int64_t page_count = query_int64(page_count_);
+  int64_t freelist_count = query_int64(freelist_count_);
+  if (page_count < 0 || freelist_count < 0)
+    return false;
+  used_bytes_ = (page_count - freelist_count) * page_size_;
+
+  const int64_t now = get_monotonic_usec();
+  if (now - ts_rate_begin_ >= DB_RETENTION_CHECK_USEC) {
+    const uint64_t evicted = evicted_rows_.load();
+    eviction_rate_ = (evicted - evicted_at_rate_begin_) * 1000000 / (now - ts_rate_begin_);
+    evicted_at_rate_begin_ = evicted;
+    ts_rate_begin_ = now;
+  }
+
+  // the row and byte limits evict the oldest rows regardless of their
+  // age
+  const uint64_t rows = rows_.load();
+  uint64_t count = 0;
+  int64_t before = INT64_MAX;
+  if (max_rows_ && rows > max_rows_)
+    count = std::min<uint64_t>(rows - max_rows_, eviction_batch_rows_);
+  if (max_bytes_ && used_bytes_.load() > max_bytes_)
+    count = eviction_batch_rows_;
+  // rows age slowly, so they are checked much less often than the
+  // size of the cache
+  if (!count && max_age_sec_ && now >= ts_next_age_check_) {
+    count = eviction_batch_rows_;
+    before = time(NULL) - max_age_sec_;
+    ts_next_age_check_ = now + DB_AGE_CHECK_USEC;
+  }
+  if (!count)
+    return false;
+
+  // evict in a transaction of its own; tick() only gets here once the
+  // open group, if any, is committed
+  if (!commit())
+    return false;
+
+  sqlite3_reset(evict_);
+  sqlite3_bind_int64(evict_, 1, count);
+  sqlite3_bind_int64(evict_, 2, before);
+  if (sqlite3_step(evict_) != SQLITE_DONE) {
+    fprintf(stderr, "ERROR: %s, evict failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+    return false;
+  }
+
+  const uint64_t evicted = sqlite3_changes(db_handle_);
+  if (!evicted)
+    return false;
+  rows_.fetch_sub(std::min(evicted, rows), std::memory_order_relaxed);
+  evicted_rows_.fetch_add(evicted, std::memory_order_relaxed);
+  eviction_batches_.fetch_add(1, std::memory_order_relaxed);
+
+  // the batch bounds the number of pages freed at once
+  if (incremental_vacuum_) {
+    freelist_count = query_int64(freelist_count_);
+    if (freelist_count > 0 && exec("PRAGMA incremental_vacuum;"))
+      vacuumed_pages_.fetch_add(freelist_count, std::memory_order_relaxed);
+  }
+
+  // keep going while whole batches of expired rows come out
+  if (evicted == count && before != INT64_MAX)
+    ts_next_age_check_ = now;
+  return evicted == count;
+}
+
+void DBInterface::maintain_dictionary() {
+  if (!compression_)
+    return;
+
+  const time_t now = time(NULL);
+  if (now < ts_next_training_ || rows_.load() < dict_sample_rows_)
+    return;
+
+  // sample the most recent rows, including the uncommitted ones
+  if (!commit())
+    return;
+
+  sqlite3_stmt *stmt = NULL;
+  if (!prepare("SELECT data, codec, dict_version FROM cache ORDER BY id DESC LIMIT @count;", &stmt))
+    return;
+
+  std::vector<std::string> samples;
+  char buf[MsgBuffer::kCapacity];
+  sqlite3_bind_int64(stmt, 1, dict_sample_rows_);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *data = static_cast<const char*>(sqlite3_column_blob(stmt, 0));
+    const int len = sqlite3_column_bytes(stmt, 0);
+    if (sqlite3_column_int(stmt, 1) == DBCodec::CODEC_RAW) {
+      samples.emplace_back(data, len);
+      continue;
+    }
+
+    const int64_t version = sqlite3_column_int64(stmt, 2);
+    const ssize_t size = codec_.load(db_handle_, version) ?
+        codec_.decompress(version, data, len, buf, sizeof(buf)) : -1;
+    if (size >= 0)
+      samples.emplace_back(buf, size);
+  }
+  finalize(&stmt);
+
+  const int64_t ts_begin = get_monotonic_usec();
+  if (!codec_.train(db_handle_, samples, dict_bytes_, now)) {
+    ts_next_training_ = now + DB_DICT_RETRY_SEC;
+    return;
+  }
+  fprintf(stderr, "INFO: DB dictionary trained in %" PRId64 " usec\n", get_monotonic_usec() - ts_begin);
+
+  ts_next_training_ = dict_max_age_sec_ ? now + dict_max_age_sec_ : INT64_MAX;
+  dict_version_ = codec_.get_version();
+  dict_size_ = codec_.get_dictionary_size();
+  prune_dictionaries();
+}
+
+void DBInterface::prune_dictionaries() {
+  // rows only ever switch to newer dictionaries, so the oldest
+  // compressed row uses the oldest dictionary still needed
+  sqlite3_stmt *stmt = NULL;
+  if (!prepare("DELETE FROM dicts WHERE version < IFNULL((SELECT dict_version FROM cache"
+               " WHERE dict_version IS NOT NULL ORDER BY id LIMIT 1), @current) AND version < @current;", &stmt))
+    return;
+
+  sqlite3_bind_int64(stmt, 1, codec_.get_version());
+  if (sqlite3_step(stmt) != SQLITE_DONE)
+    fprintf(stderr, "WARNING: %s failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+  else if (sqlite3_changes(db_handle_))
+    fprintf(stderr, "INFO: dropped %d unused DB dictionaries\n", sqlite3_changes(db_handle_));
+  finalize(&stmt);
+}
+
+void DBInterface::finalize(sqlite3_stmt **stmt) {
+  if (!*stmt)
+    return;
+
+  int res = sqlite3_finalize(*stmt);
+  if (res != SQLITE_OK)
+    // soft error
+    fprintf(stderr, "WARNING: %s, finalize stmt failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+
+  *stmt = NULL;
+}
+
 void DBInterface::close_handle() {
   if (sqlite3_close(db_handle_) != SQLITE_OK)
     fprintf(stderr, "ERROR: sqlite3_close %s: %s\n", db_filename_.c_str(), sqlite3_errmsg(db_handle_));
   db_handle_ = NULL;
 }
 
+int64_t DBInterface::get_monotonic_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 } // namespace lib
 } // namespace freud
@@ -18,33 +18,163 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
 #include <string>
 #include <sqlite3.h>
 #include "lib/configurator.h"
+#include "lib/db_codec.h"
+#include "lib/msg_pool.h"
+#include "lib/report_decoder.h"
+#include "lib/sink.h"
+
+// how often the size of the cache is sampled, and retention limits
+// are enforced, while they are not exceeded
+#define DB_RETENTION_CHECK_USEC 1000000
+// how often rows are checked against db_max_age_sec
+#define DB_AGE_CHECK_USEC 60000000
+// how long a connection waits for another one to release the database
+#define DB_BUSY_TIMEOUT_MSEC 5000
+// how many times a COMMIT that still finds the database busy is
+// retried, and how long to wait between attempts, before giving up
+// and rolling the group back
+#define DB_COMMIT_RETRIES 5
+#define DB_COMMIT_RETRY_USEC 200000
+// db_index_metadata may cost at most this share of the insert
+// throughput, as measured by db_bench with the default settings
+#define DB_INDEX_MAX_SLOWDOWN_PCT 25
+// how long to wait before training a dictionary again, after failing to
+#define DB_DICT_RETRY_SEC 600
 
 namespace freud {
 namespace lib {
 
-class DBInterface {
+// Caches packets in SQLite, in WAL mode by default. Inserts are grouped in
+// transactions, committed once they hold enough packets or once the
+// oldest of them has waited long enough, so that the cost of syncing is
+// shared by many packets. Once the cache exceeds its retention limits,
+// the oldest rows are evicted in batches, and the pages they free are
+// returned to the filesystem with incremental vacuum. Along with each
+// packet, the fields most queries filter on are stored in columns of
+// their own, and indexed by time. Packets can be stored compressed,
+// with a dictionary trained on the cache itself once it holds enough of
+// them.
+class DBInterface : public Sink {
  public:
   explicit DBInterface(const Configurator &config);
-  ~DBInterface();
+  ~DBInterface() override;
 
   bool init();
   void fini();
 
-  bool cache_packet(const std::string &s);
+  // the packet is durable only once its transaction is committed
+  // now is stored along with the packet, to enforce the maximum age
+  bool cache_packet(const MsgBuffer &msg, const time_t now);
+  // returns the number of packets cached successfully
+  size_t cache_packets(MsgBuffer *const *msgs, const size_t count);
+  // commit the open transaction, if any
+  bool commit();
+
+  // Sink interface
+  const char* get_sink_name() const override { return "DB"; }
+  size_t consume_batch(MsgBuffer *const *msgs, const size_t count) override {
+    return cache_packets(msgs, count);
+  }
+  int64_t tick(const bool idle) override;
+  void flush() override { (void) commit(); }
+  void dump_stats(FILE *fp) const override;
 
  private:
   std::string db_directory_;
   std::string db_filename_;
+  const std::string synchronous_;
+  const std::string journal_mode_;
+  const uint64_t journal_size_limit_;
+  const uint32_t commit_max_packets_;
+  const int64_t commit_max_usec_;
+  // 0 means no limit
+  const uint64_t max_rows_;
+  const uint64_t max_bytes_;
+  const time_t max_age_sec_;
+  const uint32_t eviction_batch_rows_;
+  const bool index_metadata_;
+  const bool compression_;
+  const uint32_t dict_bytes_;
+  const uint32_t dict_sample_rows_;
+  // 0 means never retrain
+  const time_t dict_max_age_sec_;
   bool fini_called_;
   sqlite3 *db_handle_;
 
   // prepared statements
   sqlite3_stmt *insert_pkt_cache_;
+  sqlite3_stmt *begin_;
+  sqlite3_stmt *commit_;
+  sqlite3_stmt *evict_;
+  sqlite3_stmt *page_count_;
+  sqlite3_stmt *freelist_count_;
+
+  // the open transaction, if any
+  bool in_transaction_;
+  uint32_t transaction_packets_;
+  int64_t ts_transaction_begin_; // monotonic usec
+
+  std::atomic<uint64_t> commits_;
+  std::atomic<uint64_t> committed_packets_;
+  std::atomic<uint64_t> lost_packets_;
+  std::atomic<uint64_t> commit_retries_;
+  std::atomic<uint64_t> write_usec_;
 
+  // retention
+  int64_t page_size_;
+  bool incremental_vacuum_;
+  int64_t ts_next_retention_; // monotonic usec
+  int64_t ts_next_age_check_; // monotonic usec
+  int64_t ts_rate_begin_; // monotonic usec
+  uint64_t evicted_at_rate_begin_;
+  std::atomic<uint64_t> rows_;
+  std::atomic<uint64_t> used_bytes_;
+  std::atomic<uint64_t> evicted_rows_;
+  std::atomic<uint64_t> eviction_batches_;
+  std::atomic<uint64_t> eviction_rate_; // rows/sec
+  std::atomic<uint64_t> vacuumed_pages_;
+
+  // compression
+  DBCodec codec_;
+  std::string compressed_; // reused across packets
+  time_t ts_next_training_; // wall clock, 0 means as soon as possible
+  std::atomic<int64_t> dict_version_;
+  std::atomic<uint64_t> dict_size_;
+  std::atomic<uint64_t> compressed_rows_;
+  std::atomic<uint64_t> uncompressed_rows_;
+  std::atomic<uint64_t> raw_bytes_;
+  std::atomic<uint64_t> stored_bytes_;
+
+  bool begin();
+  // returns false on errors
+  bool exec(const char *sql);
+  bool prepare(const char *sql, sqlite3_stmt **stmt);
+  void finalize(sqlite3_stmt **stmt);
+  // returns the first column of the first row of stmt, or -1 on errors
+  int64_t query_int64(sqlite3_stmt *stmt);
+  // add columns missing from databases created by older versions
+  bool migrate();
+  // bind the metadata columns of the insert statement; they are left
+  // NULL for packets that were not decoded
+  bool bind_metadata(const DecodedReport *report);
+  // sample the size of the cache, and evict a batch of rows if it
+  // exceeds any limit; returns true if more rows may need evicting
+  bool enforce_retention();
+  // train a dictionary, from the most recent rows, if there is none yet
+  // or the current one is too old
+  void maintain_dictionary();
+  // drop the dictionaries that no row needs anymore
+  void prune_dictionaries();
   void close_handle();
+
+  static int64_t get_monotonic_usec();
 };
 
 } // namespace lib
@@ -0,0 +1,343 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/db_replay.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+
+namespace freud {
+namespace lib {
+
+DBReplayer::DBReplayer(const Configurator &config, SinkWorker *sink, const std::string &hostname)
+    : db_filename_(config.get_database_directory() + "/sqlite.db"), sink_(sink),
+      batch_size_(config.get_dispatch_batch_size()), max_rate_(config.get_db_replay_max_rate()),
+      pool_(4 * batch_size_), decoder_(pool_, hostname), batch_(batch_size_), row_ids_(batch_size_),
+      codec_(Z_DEFAULT_COMPRESSION), db_handle_(NULL), select_rows_(NULL), select_target_(NULL), save_hwm_(NULL),
+      worker_(NULL), stopping_(false), requested_(config.get_db_replay_on_start()),
+      running_(false), hwm_(0), saved_hwm_(0), target_(0), runs_(0), replayed_rows_(0), rejected_rows_(0),
+      throttled_usec_(0) {
+}
+
+DBReplayer::~DBReplayer() {
+  stop();
+}
+
+void DBReplayer::start() {
+  if (worker_)
+    return;
+
+  stopping_ = false;
+  worker_ = new std::thread(&DBReplayer::worker_fn, this);
+}
+
+void DBReplayer::stop() {
+  if (!worker_)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+
+  worker_->join();
+  delete worker_;
+  worker_ = NULL;
+}
+
+void DBReplayer::request() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (requested_ || running_.load()) {
+      fprintf(stderr, "NOTICE: DB replay already in progress\n");
+      return;
+    }
+    requested_ = true;
+  }
+  wakeup_.notify_one();
+}
+
+void DBReplayer::dump_stats(FILE *fp) const {
+  fprintf(fp, "STATS: DB replay: %s, at row %" PRId64 " (%" PRId64 " saved) of %" PRId64 ", %" PRIu64 " runs, %" PRIu64
+          " rows replayed, %" PRIu64 " rows rejected, %" PRIu64 " usec held back\n",
+          running_.load() ? "running" : "idle", hwm_.load(), saved_hwm_.load(), target_.load(), runs_.load(),
+          replayed_rows_.load(), rejected_rows_.load(), throttled_usec_.load());
+}
+
+bool DBReplayer::open() {
+  // the DB sink creates the database
+  int res = sqlite3_open_v2(db_filename_.c_str(), &db_handle_, SQLITE_OPEN_READWRITE, NULL);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "ERROR: sqlite3_open %s: %s\n", db_filename_.c_str(), sqlite3_errmsg(db_handle_));
+    close();
+    return false;
+  }
+
+  // the DB sink might be writing at the same time
+  sqlite3_busy_timeout(db_handle_, DB_BUSY_TIMEOUT_MSEC);
+
+  char *errmsg = NULL;
+  res = sqlite3_exec(db_handle_, "CREATE TABLE IF NOT EXISTS replay_state (name TEXT PRIMARY KEY, value INTEGER);",
+                     NULL, NULL, &errmsg);
+  if (res != SQLITE_OK) {
+    fprintf(stderr, "ERROR: sqlite3_exec %s: %s\n", db_filename_.c_str(), errmsg ? errmsg : "");
+    sqlite3_free(errmsg);
+    close();
+    return false;
+  }
+
+  const char *const sqls[] = {
+    "SELECT id, data, codec, dict_version FROM cache WHERE id > @hwm AND id <= @target"
+    " ORDER BY id LIMIT @count;",
+    "SELECT IFNULL(MAX(id), 0), (SELECT value FROM replay_state WHERE name = 'es_hwm') FROM cache;",
+    "INSERT OR REPLACE INTO replay_state (name, value) VALUES ('es_hwm', @hwm);",
+  };
+  sqlite3_stmt **const stmts[] = { &select_rows_, &select_target_, &save_hwm_ };
+  for (size_t i = 0; i < sizeof(stmts) / sizeof(stmts[0]); ++i) {
+    res = sqlite3_prepare_v2(db_handle_, sqls[i], -1, stmts[i], NULL);
+    if (res != SQLITE_OK) {
+      fprintf(stderr, "ERROR: prepared stmt '%s' failed: %s\n", sqls[i], sqlite3_errmsg(db_handle_));
+      close();
+      return false;
+    }
+  }
+
+  if (sqlite3_step(select_target_) != SQLITE_ROW) {
+    fprintf(stderr, "ERROR: %s, reading the replay position failed: %s\n", __FUNCTION__,
+            sqlite3_errmsg(db_handle_));
+    close();
+    return false;
+  }
+  target_ = sqlite3_column_int64(select_target_, 0);
+  hwm_ = sqlite3_column_int64(select_target_, 1);
+  saved_hwm_ = hwm_.load();
+  sqlite3_reset(select_target_);
+  return true;
+}
+
+void DBReplayer::close() {
+  sqlite3_stmt **const stmts[] = { &select_rows_, &select_target_, &save_hwm_ };
+  for (sqlite3_stmt **stmt : stmts) {
+    sqlite3_finalize(*stmt);
+    *stmt = NULL;
+  }
+
+  if (sqlite3_close(db_handle_) != SQLITE_OK)
+    fprintf(stderr, "ERROR: sqlite3_close %s: %s\n", db_filename_.c_str(), sqlite3_errmsg(db_handle_));
+  db_handle_ = NULL;
+}
+
+int64_t DBReplayer::get_settled_hwm() {
+  // buffers return to the pool once consumed; until all of them have,
+  // only the rows up to the last consumed one reached the sink. Those
+  // it still buffers hold the mark back
+  const int64_t consumed = pool_.get_available() == pool_.get_capacity() ? hwm_.load() :
+      sink_->get_consumed_replay_id();
+  return std::min(consumed, sink_->get_unsettled_replay_id() - 1);
+}
+
+bool DBReplayer::save_hwm() {
+  const int64_t hwm = std::max(get_settled_hwm(), saved_hwm_.load());
+  if (hwm == saved_hwm_.load())
+    return true;
+
+  sqlite3_reset(save_hwm_);
+  sqlite3_bind_int64(save_hwm_, 1, hwm);
+  if (sqlite3_step(save_hwm_) != SQLITE_DONE) {
+    fprintf(stderr, "WARNING: %s failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+    return false;
+  }
+  saved_hwm_ = hwm;
+  return true;
+}
+
+bool DBReplayer::replay() {
+  const ByteBudget &budget = sink_->get_budget();
+  int64_t ts_next_batch = get_monotonic_usec();
+  int64_t ts_next_save = ts_next_batch + DB_REPLAY_SAVE_USEC;
+  while (hwm_.load() < target_.load()) {
+    // live traffic first: hold back while the sink is busy with it
+    if (budget.get_used() > budget.get_low_watermark() / 2) {
+      throttled_usec_.fetch_add(DB_REPLAY_BACKOFF_USEC, std::memory_order_relaxed);
+      if (!sleep_usec(DB_REPLAY_BACKOFF_USEC))
+        return false;
+      continue;
+    }
+
+    int64_t now = get_monotonic_usec();
+    if (now < ts_next_batch) {
+      if (!sleep_usec(ts_next_batch - now))
+        return false;
+      continue;
+    }
+
+    const ssize_t count = replay_batch(batch_size_);
+    if (count < 0)
+      return false;
+    if (count == 0) {
+      // all buffers are still queued in the sink, or it is full
+      if (!sleep_usec(DB_REPLAY_BACKOFF_USEC))
+        return false;
+      continue;
+    }
+
+    now = get_monotonic_usec();
+    if (max_rate_)
+      ts_next_batch = std::max(ts_next_batch, now - 1000000) + count * 1000000L / max_rate_;
+    if (now >= ts_next_save) {
+      (void) save_hwm();
+      ts_next_save = now + DB_REPLAY_SAVE_USEC;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_)
+      return false;
+  }
+
+  return true;
+}
+
+ssize_t DBReplayer::replay_batch(const size_t count) {
+  MsgBuffer **const bufs = batch_.data();
+  const size_t acquired = pool_.acquire_batch(bufs, std::min(count, batch_.size()));
+  if (!acquired)
+    return 0;
+
+  sqlite3_reset(select_rows_);
+  sqlite3_bind_int64(select_rows_, 1, hwm_.load());
+  sqlite3_bind_int64(select_rows_, 2, target_.load());
+  sqlite3_bind_int64(select_rows_, 3, acquired);
+
+  size_t used = 0;
+  size_t kept = 0;
+  int res;
+  while ((res = sqlite3_step(select_rows_)) == SQLITE_ROW) {
+    MsgBuffer *msg = bufs[used];
+    row_ids_[used++] = sqlite3_column_int64(select_rows_, 0);
+    msg->set_replay_id(row_ids_[used - 1]);
+    const void *data = sqlite3_column_blob(select_rows_, 1);
+    const size_t len = sqlite3_column_bytes(select_rows_, 1);
+    ssize_t size;
+    if (sqlite3_column_int(select_rows_, 2) == DBCodec::CODEC_RAW) {
+      size = std::min(len, MsgBuffer::kCapacity);
+      if (size)
+        memcpy(msg->data(), data, size);
+    } else {
+      const int64_t version = sqlite3_column_int64(select_rows_, 3);
+      size = codec_.load(db_handle_, version) ?
+          codec_.decompress(version, data, len, msg->data(), MsgBuffer::kCapacity) : -1;
+    }
+
+    if (size >= 0)
+      msg->set_size(size);
+
+    // malformed reports are cached too, and just skipped here
+    if (size >= 0 && decoder_.decode(msg)) {
+      bufs[kept++] = msg;
+    } else {
+      rejected_rows_.fetch_add(1, std::memory_order_relaxed);
+      msg->unref();
+    }
+  }
+  sqlite3_reset(select_rows_);
+
+  // on errors, nothing is pushed and the position stays put
+  size_t done = 0;
+  if (res == SQLITE_DONE) {
+    // one at a time, to stop at the first message the sink cannot take:
+    // that row, and those after it, are read again on the next pass
+    size_t pushed = 0;
+    while (pushed < kept && sink_->push_batch(&bufs[pushed], 1))
+      ++pushed;
+    replayed_rows_.fetch_add(pushed, std::memory_order_relaxed);
+
+    done = used;
+    if (pushed < kept)
+      // rows rejected before it are done with too
+      done = std::lower_bound(row_ids_.data(), row_ids_.data() + used, bufs[pushed]->get_replay_id()) -
+          row_ids_.data();
+    if (done)
+      hwm_ = row_ids_[done - 1];
+    else if (!used)
+      // the remaining rows were evicted in the meantime
+      hwm_ = target_.load();
+  } else {
+    fprintf(stderr, "ERROR: %s, reading rows failed: %s\n", __FUNCTION__, sqlite3_errmsg(db_handle_));
+  }
+
+  for (size_t i = 0; i < kept; ++i)
+    bufs[i]->unref();
+  for (size_t i = used; i < acquired; ++i)
+    bufs[i]->unref();
+  return res == SQLITE_DONE ? (used ? done : 1) : -1;
+}
+
+bool DBReplayer::sleep_usec(const int64_t usec) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  wakeup_.wait_for(lock, std::chrono::microseconds(usec), [this]{ return stopping_; });
+  return !stopping_;
+}
+
+void DBReplayer::worker_fn() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (!requested_) {
+      wakeup_.wait(lock);
+      continue;
+    }
+
+    running_ = true;
+    requested_ = false;
+    lock.unlock();
+
+    runs_.fetch_add(1, std::memory_order_relaxed);
+    if (open()) {
+      if (hwm_.load() >= target_.load()) {
+        fprintf(stderr, "INFO: DB replay found no new rows after row %" PRId64 "\n", hwm_.load());
+      } else {
+        fprintf(stderr, "INFO: replaying DB rows %" PRId64 " to %" PRId64 "\n", hwm_.load() + 1, target_.load());
+        const bool done = replay();
+        // unless stopping, wait for the sink to settle the rows in
+        // flight, so that the next replay does not send them again
+        while (get_settled_hwm() < hwm_.load())
+          if (!sleep_usec(DB_REPLAY_BACKOFF_USEC))
+            break;
+        (void) save_hwm();
+        fprintf(stderr, "INFO: DB replay %s at row %" PRId64 "\n", done ? "completed" : "interrupted",
+                saved_hwm_.load());
+      }
+      close();
+    }
+
+    lock.lock();
+    running_ = false;
+  }
+}
+
+int64_t DBReplayer::get_monotonic_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,126 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sqlite3.h>
+#include "lib/configurator.h"
+#include "lib/db_codec.h"
+#include "lib/db_interface.h"
+#include "lib/msg_pool.h"
+#include "lib/report_decoder.h"
+#include "lib/sink_worker.h"
+
+// how often the replay position is persisted while replaying
+#define DB_REPLAY_SAVE_USEC 1000000
+// how long the replay waits for the sink, or for free buffers
+#define DB_REPLAY_BACKOFF_USEC 10000
+
+namespace freud {
+namespace lib {
+
+// Replays the packets cached in the DB to a sink (i.e. ES), in id
+// order, from a background thread with its own DB connection. A replay
+// covers the rows cached before it was requested, starting after the
+// last row replayed so far: that high-water mark is persisted in the
+// replay_state table, so an interrupted replay resumes where it stopped.
+// The persisted mark only covers rows the sink has delivered, spooled
+// or given up on; delivery is at-least-once, rows still in flight when
+// the daemon stops are replayed again.
+// Replayed packets are paced to a maximum rate, and held back while the
+// queue of the sink is filling up, so that live traffic always comes
+// first.
+class DBReplayer {
+ public:
+  DBReplayer(const Configurator &config, SinkWorker *sink, const std::string &hostname);
+  ~DBReplayer();
+
+  void start();
+  void stop();
+
+  // start a replay, unless one is running already
+  void request();
+
+  void dump_stats(FILE *fp) const;
+
+ private:
+  const std::string db_filename_;
+  SinkWorker *const sink_;
+  const uint32_t batch_size_;
+  // rows/sec, 0 means no limit
+  const uint32_t max_rate_;
+
+  MsgPool pool_;
+  ReportDecoder decoder_;
+  std::vector<MsgBuffer*> batch_;
+  // the ids of the rows read into batch_, in order
+  std::vector<int64_t> row_ids_;
+  // rows might have been compressed
+  DBCodec codec_;
+
+  sqlite3 *db_handle_;
+  sqlite3_stmt *select_rows_;
+  sqlite3_stmt *select_target_;
+  sqlite3_stmt *save_hwm_;
+
+  std::thread *worker_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  bool stopping_;
+  bool requested_;
+
+  std::atomic<bool> running_;
+  // the last row handed to the sink, and the last one persisted
+  std::atomic<int64_t> hwm_;
+  std::atomic<int64_t> saved_hwm_;
+  std::atomic<int64_t> target_;
+  std::atomic<uint64_t> runs_;
+  std::atomic<uint64_t> replayed_rows_;
+  std::atomic<uint64_t> rejected_rows_;
+  std::atomic<uint64_t> throttled_usec_;
+
+  bool open();
+  void close();
+  // the rows up to the returned id are settled in the sink
+  int64_t get_settled_hwm();
+  // persist the settled part of hwm_
+  bool save_hwm();
+  // returns false if stopped before the replay completed
+  bool replay();
+  // returns the number of rows handed to the sink, or -1 on errors
+  ssize_t replay_batch(const size_t count);
+  // returns false if stopping
+  bool sleep_usec(const int64_t usec);
+
+  void worker_fn();
+
+  static int64_t get_monotonic_usec();
+};
+
+} // namespace lib
+} // namespace freud
@@ -18,6 +18,15 @@
 
 #include "lib/dispatcher.h"
 
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h> // for gethostname
+
+// each sink may hold at most this fraction (1/N) of the buffers of a
+// shard's pool, so that a stalled sink leaves enough of them to the
+// listeners and to the other sink
+#define SINK_POOL_SHARE 4
+
 namespace freud {
 namespace lib {
 
@@ -28,41 +37,170 @@ uint64_t get_usec_wallclock_time(void) {
 }
 
 Dispatcher::Dispatcher(const Configurator &config, DBInterface *db, ElasticSearchInterface *es)
-    : db_(db), es_(es),
-      inbound_queue_(10000), // tail-drop packets if we have more than 10k messages in the queue
-      ts_last_warning_(0),
-      cache_packets_in_db_(config.get_cache_packets_in_db()),
-      send_packets_to_es_(config.get_send_packets_to_es()) {
-  worker_ = new std::thread(&Dispatcher::worker_fn, this);
+    : batch_size_(config.get_dispatch_batch_size()),
+      batch_wait_usec_(config.get_dispatch_batch_wait_usec()),
+      inbound_budget_(config.get_inbound_high_watermark_bytes(), config.get_inbound_low_watermark_bytes()),
+      filter_(config), replayer_(NULL) {
+  char buf[256];
+  if (gethostname(buf, sizeof(buf)) < 0) {
+    // error case
+    hostname_ = "undefined";
+  } else {
+    // success case
+
+    // man gethostname(2) states that POSIX does not require
+    // gethostname() to raise an error if a name truncation occurred;
+    // hence, to be safe, always put a \0 at the end of the buffer
+    buf[sizeof(buf) - 1] = '\0';
+
+    hostname_ = buf;
+  }
+
+  // each sink gets its own queue and worker; sinks hold buffers from
+  // every shard, so the cap is on the total
+  size_t sink_max_msgs = config.get_msg_pool_size() / SINK_POOL_SHARE;
+  if (sink_max_msgs < 2)
+    sink_max_msgs = 2;
+  if (config.get_cache_packets_in_db())
+    sinks_.push_back(new SinkWorker(db, config.get_db_queue(), sink_max_msgs, batch_size_, batch_wait_usec_));
+  if (config.get_send_packets_to_es()) {
+    sinks_.push_back(new SinkWorker(es, config.get_es_queue(), sink_max_msgs, batch_size_, batch_wait_usec_));
+    replayer_ = new DBReplayer(config, sinks_.back(), hostname_);
+  }
+
+  for (uint32_t i = 0; i < config.get_udp_listener_shards(); ++i)
+    shards_.push_back(new Shard(config.get_msg_pool_size(), config, &inbound_drops_, &inbound_budget_,
+                                hostname_));
+
+  for (Shard *shard : shards_)
+    shard->worker = new std::thread(&Dispatcher::worker_fn, this, shard);
+
+  if (replayer_)
+    replayer_->start();
 }
 
 Dispatcher::~Dispatcher() {
   stop_and_wait();
+
+  // sinks might still hold pooled buffers until they are gone
+  for (SinkWorker *sink : sinks_)
+    delete sink;
+  sinks_.clear();
+
+  // replayed messages come from its own pool
+  delete replayer_;
+  replayer_ = NULL;
+
+  for (Shard *shard : shards_)
+    delete shard;
+  shards_.clear();
+}
+
+void Dispatcher::msg_received(const size_t shard, MsgBuffer *msg) {
+  msgs_received(shard, &msg, 1);
+}
+
+void Dispatcher::msgs_received(const size_t shard, MsgBuffer *const *msgs, const size_t count) {
+  Shard *s = shards_[shard];
+
+  size_t enqueued = 0, filtered = 0;
+  for (size_t i = 0; i < count; ++i) {
+    ReportPeek peek;
+    peek_report(msgs[i]->data(), msgs[i]->size(), filter_.get_peek_fields(), &peek);
+    if (filter_.is_filtered(peek)) {
+      // nobody wants this one, do not even queue it
+      filtered_.count(*msgs[i]);
+      msgs[i]->unref();
+      ++filtered;
+      continue;
+    }
+
+    MsgQueue *lane = s->lanes[peek.rc == REPORT_CLASS_SUMMARY ? LANE_SUMMARY : LANE_DETAILED];
+    if (lane->push_deferred(msgs[i]))
+      ++enqueued;
+  }
+
+  if (enqueued)
+    // all lanes share the same doorbell, ring it once for the batch
+    s->bell.ring();
+
+  if (enqueued + filtered != count)
+    warn_dropped(s, count - enqueued - filtered);
+}
+
+void Dispatcher::msg_dropped(const size_t shard, const char *data, const size_t len) {
+  inbound_drops_.count(data, len);
+  warn_dropped(shards_[shard], 1);
 }
 
-void Dispatcher::msg_received(std::string *msg) {
-  if (!inbound_queue_.push(msg)) {
-    // message has been tail-dropped, free the memory used
-    delete msg;
-
-    // print a warning every hour at most
-    const uint64_t now = get_usec_wallclock_time();
-    if (now > (ts_last_warning_ + 3600 * 1000000L)) {
-      struct tm broken_down_time;
-      const time_t ts = now / 1000000; // seconds since Epoch (UTC)
-      if (gmtime_r(&ts, &broken_down_time)) {
-        fprintf(stderr, "WARNING: inbound queue dropped one message @ %.4d-%.2d-%.2d %.2d:%.2d:%.2d\n",
-                broken_down_time.tm_year + 1900, broken_down_time.tm_mon + 1, broken_down_time.tm_mday,
-                broken_down_time.tm_hour, broken_down_time.tm_min, broken_down_time.tm_sec);
-        ts_last_warning_ = now;
-      }
+void Dispatcher::warn_dropped(Shard *shard, const size_t count) {
+  // print a warning every hour at most, per shard
+  const uint64_t now = get_usec_wallclock_time();
+  if (now > (shard->ts_last_warning + 3600 * 1000000L)) {
+    struct tm broken_down_time;
+    const time_t ts = now / 1000000; // seconds since Epoch (UTC)
+    if (gmtime_r(&ts, &broken_down_time)) {
+      fprintf(stderr, "WARNING: inbound queue dropped %zu message(s) @ %.4d-%.2d-%.2d %.2d:%.2d:%.2d\n",
+              count,
+              broken_down_time.tm_year + 1900, broken_down_time.tm_mon + 1, broken_down_time.tm_mday,
+              broken_down_time.tm_hour, broken_down_time.tm_min, broken_down_time.tm_sec);
+      shard->ts_last_warning = now;
     }
   }
 }
 
+void Dispatcher::warn_rejected(Shard *shard, const size_t count) {
+  // print a warning every hour at most, per shard
+  const uint64_t now = get_usec_wallclock_time();
+  if (now > (shard->ts_last_reject_warning + 3600 * 1000000L)) {
+    fprintf(stderr, "WARNING: rejected %zu malformed message(s)\n", count);
+    shard->ts_last_reject_warning = now;
+  }
+}
+
+void Dispatcher::replay_db() {
+  if (replayer_)
+    replayer_->request();
+  else
+    fprintf(stderr, "WARNING: not replaying the DB, packets are not sent to ES\n");
+}
+
+void Dispatcher::dump_stats(FILE *fp) {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    MsgPool &pool = shards_[i]->pool;
+    fprintf(fp, "STATS: shard %zu msg pool: capacity %zu, available %zu, exhausted %" PRIu64 "\n",
+            i, pool.get_capacity(), pool.get_available(), pool.get_exhausted_count());
+  }
+
+  for (size_t i = 0; i < shards_.size(); ++i)
+    for (size_t l = 0; l < LANE_COUNT; ++l) {
+      const ByteBudget &budget = shards_[i]->lanes[l]->get_budget();
+      fprintf(fp, "STATS: shard %zu %s lane: used %" PRIu64 " bytes, high watermark %" PRIu64
+              ", low watermark %" PRIu64 ", %s\n",
+              i, l == LANE_SUMMARY ? "summary" : "detailed",
+              budget.get_used(), budget.get_high_watermark(), budget.get_low_watermark(),
+              budget.is_shedding() ? "shedding" : "admitting");
+    }
+
+  fprintf(fp, "STATS: inbound budget: used %" PRIu64 " bytes, high watermark %" PRIu64 ", low watermark %" PRIu64
+          ", %s\n",
+          inbound_budget_.get_used(), inbound_budget_.get_high_watermark(), inbound_budget_.get_low_watermark(),
+          inbound_budget_.is_shedding() ? "shedding" : "admitting");
+  inbound_drops_.dump(fp, "inbound");
+  filtered_.dump(fp, "report filter");
+  decode_rejects_.dump(fp, "decode stage");
+
+  for (SinkWorker *sink : sinks_)
+    sink->dump_stats(fp);
+  if (replayer_)
+    replayer_->dump_stats(fp);
+}
+
 void Dispatcher::stop() {
-  // ignore all errors
-  (void) inbound_queue_.push(NULL);
+  // workers exit once their lanes have been drained
+  for (Shard *shard : shards_)
+    for (MsgQueue *lane : shard->lanes)
+      lane->close();
 }
 
 void Dispatcher::stop_and_wait() {
@@ -70,32 +208,102 @@ void Dispatcher::stop_and_wait() {
   wait();
 }
 
-void Dispatcher::worker_fn() {
+size_t Dispatcher::pop_batch(Shard *shard, MsgBuffer **batch) {
+  size_t count = 0;
+  int64_t deadline = 0;
+
+  while (true) {
+    // service the lanes in priority order
+    for (size_t l = 0; l < LANE_COUNT && count < batch_size_; ++l)
+      count += shard->lanes[l]->nonblocking_pop_batch(batch + count, batch_size_ - count);
+    if (count == batch_size_)
+      return count;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const int64_t now = ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    if (count) {
+      // the first messages are in, wait a bit more for the batch to fill
+      if (!deadline)
+        deadline = now + batch_wait_usec_;
+      if (now >= deadline)
+        return count;
+    }
+
+    const uint32_t ticket = shard->bell.prepare_wait();
+    bool ready = false;
+    for (MsgQueue *lane : shard->lanes)
+      if (!lane->is_empty())
+        ready = true;
+    if (ready) {
+      shard->bell.cancel_wait();
+      continue;
+    }
+    if (shard->lanes[LANE_SUMMARY]->is_closed()) {
+      // all lanes are closed together
+      shard->bell.cancel_wait();
+      return count;
+    }
+    shard->bell.wait(ticket, count ? deadline - now : -1);
+  }
+}
+
+size_t Dispatcher::decode_batch(Shard *shard, MsgBuffer **batch, const size_t count) {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (shard->decoder.decode(batch[i])) {
+      batch[kept++] = batch[i];
+      continue;
+    }
+
+    decode_rejects_.count(*batch[i]);
+    batch[i]->unref();
+  }
+
+  if (kept != count)
+    warn_rejected(shard, count - kept);
+  return kept;
+}
+
+void Dispatcher::worker_fn(Shard *shard) {
+  std::vector<MsgBuffer*> batch(batch_size_);
   while (true) {
-    std::string *s = inbound_queue_.pop_or_wait();
-    if (!s)
+    const size_t popped = pop_batch(shard, batch.data());
+    if (!popped)
       // stop processing events
       break;
 
-    if (cache_packets_in_db_ && !db_->cache_packet(*s))
-      fprintf(stderr, "WARNING: could not cache packet in database\n");
+    const size_t count = decode_batch(shard, batch.data(), popped);
 
-    if (send_packets_to_es_ && !es_->post_packet(*s))
-      fprintf(stderr, "WARNING: could not post packet to ElasticSearch\n");
+    // fan out: each sink takes its own reference on every message
+    for (SinkWorker *sink : sinks_)
+      (void) sink->push_batch(batch.data(), count);
 
-    delete s;
+    for (size_t i = 0; i < count; ++i)
+      batch[i]->unref();
   }
 }
 
 void Dispatcher::wait() {
-  std::thread *local_worker = worker_;
-  worker_ = NULL;
+  for (Shard *shard : shards_) {
+    std::thread *local_worker = shard->worker;
+    shard->worker = NULL;
+
+    if (!local_worker)
+      continue;
+
+    local_worker->join();
+    delete local_worker;
+  }
 
-  if (!local_worker)
-    return;
+  if (replayer_)
+    replayer_->stop();
 
-  local_worker->join();
-  delete local_worker;
+  // no more messages can reach the sinks now, let them drain
+  for (SinkWorker *sink : sinks_)
+    sink->stop();
+  for (SinkWorker *sink : sinks_)
+    sink->wait();
 }
 
 } // namespace lib
@@ -18,10 +18,19 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <string>
 #include <thread>
+#include <vector>
+#include "lib/byte_budget.h"
 #include "lib/db_interface.h"
+#include "lib/db_replay.h"
 #include "lib/es_interface.h"
-#include "lib/sync_queue.h"
+#include "lib/msg_pool.h"
+#include "lib/msg_queue.h"
+#include "lib/report_decoder.h"
+#include "lib/report_filter.h"
+#include "lib/sink_worker.h"
 
 namespace freud {
 namespace lib {
@@ -31,25 +40,102 @@ class Dispatcher {
   Dispatcher(const Configurator &config, DBInterface *db, ElasticSearchInterface *es);
   ~Dispatcher();
 
-  // this method transfers ownership of the pointer inside the
-  // Dispatcher
-  void msg_received(std::string *msg);
+  // number of independent inbound queues; each one is expected to be
+  // fed by a single listener
+  size_t get_shard_count() const { return shards_.size(); }
+
+  // listeners receive datagrams directly into buffers taken from the
+  // pool of their shard
+  MsgPool* get_pool(const size_t shard) { return &shards_[shard]->pool; }
+
+  // this method transfers ownership of the buffer inside the
+  // Dispatcher, which returns it to the pool once done
+  void msg_received(const size_t shard, MsgBuffer *msg);
+  // same as above, for a batch of messages received together
+  void msgs_received(const size_t shard, MsgBuffer *const *msgs, const size_t count);
+  // account for a message that a listener could not even hand over
+  void msg_dropped(const size_t shard, const char *data, const size_t len);
+
+  // exact number of inbound messages, and of their bytes, dropped so
+  // far for a given class of reports
+  const DropStats& get_inbound_drops() const { return inbound_drops_; }
+  const ByteBudget& get_inbound_budget() const { return inbound_budget_; }
+  // messages discarded on receipt by the report filter
+  const DropStats& get_filtered() const { return filtered_; }
+  // messages that could not be parsed, and never reached any sink
+  const DropStats& get_decode_rejects() const { return decode_rejects_; }
+
+  // replay the packets cached in the DB to ES, in the background; a
+  // no-op if packets are not sent to ES
+  void replay_db();
+
+  void dump_stats(FILE *fp);
 
   // stop the dispacher
   void stop();
   void stop_and_wait();
 
  private:
-  DBInterface *db_;
-  ElasticSearchInterface *es_;
-  SyncQueue<std::string> inbound_queue_;
-  std::thread *worker_;
-  uint64_t ts_last_warning_; // used to throttle some warnings printed by this class
+  // inbound messages are queued in lanes, by report type; workers
+  // always service the SUMMARY lane first
+  enum LaneId {
+    LANE_SUMMARY = 0,
+    LANE_DETAILED, // also takes malformed reports, for the DB cache
+
+    LANE_COUNT
+  };
+
+  struct Shard {
+    Shard(const size_t pool_size, const Configurator &config, DropStats *drops, ByteBudget *budget,
+          const std::string &hostname)
+        : pool(pool_size), decoder(pool, hostname), worker(NULL), ts_last_warning(0), ts_last_reject_warning(0) {
+      lanes[LANE_SUMMARY] = new MsgQueue(config.get_summary_lane(), drops, MSG_QUEUE_SLOTS, budget, &bell);
+      lanes[LANE_DETAILED] = new MsgQueue(config.get_detailed_lane(), drops, MSG_QUEUE_SLOTS, budget, &bell);
+    }
+    ~Shard() {
+      for (MsgQueue *lane : lanes)
+        delete lane;
+    }
+
+    MsgPool pool;
+    ReportDecoder decoder;
+    // rung whenever any lane receives messages
+    Doorbell bell;
+    MsgQueue *lanes[LANE_COUNT];
+    std::thread *worker;
+    uint64_t ts_last_warning; // used to throttle some warnings printed by this class
+    uint64_t ts_last_reject_warning;
+  };
+
+  const uint32_t batch_size_;
+  const uint32_t batch_wait_usec_;
+
+  // bytes held by all inbound lanes, across shards
+  ByteBudget inbound_budget_;
+  DropStats inbound_drops_;
+  DropStats filtered_;
+  DropStats decode_rejects_;
+  const ReportFilter filter_;
+  // attached to every decoded report
+  std::string hostname_;
+  std::vector<Shard*> shards_;
 
-  const bool cache_packets_in_db_;
-  const bool send_packets_to_es_;
+  // every inbound message is shared, not copied, among all sinks
+  std::vector<SinkWorker*> sinks_;
+  // feeds the ES sink from the DB cache; NULL if packets are not sent
+  // to ES
+  DBReplayer *replayer_;
 
-  void worker_fn();
+  void warn_dropped(Shard *shard, const size_t count);
+  void warn_rejected(Shard *shard, const size_t count);
+  // parse every message of the batch once, for all sinks; malformed
+  // messages are counted and released. Returns the number of messages
+  // left in the batch.
+  size_t decode_batch(Shard *shard, MsgBuffer **batch, const size_t count);
+  // summaries first, then detailed reports in the remaining space;
+  // returns 0 once the shard has been stopped and drained
+  size_t pop_batch(Shard *shard, MsgBuffer **batch);
+  void worker_fn(Shard *shard);
   void wait();
 };
 
@@ -0,0 +1,106 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <atomic>
+
+namespace freud {
+namespace lib {
+
+// A futex-based wake-up primitive for lock-free queues: producers
+// ring it after publishing data, and it costs a syscall only when
+// some consumer is actually asleep.
+//
+// Consumers must follow this protocol, so that no wake-up is lost:
+//   ticket = prepare_wait();
+//   <re-check the condition>
+//   if satisfied: cancel_wait(); else: wait(ticket, ...);
+class Doorbell {
+ public:
+  Doorbell() : epoch_(0), waiters_(0), wake_pending_(0) {}
+  ~Doorbell() = default;
+
+  uint32_t prepare_wait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    // this consumer is about to re-check the condition: rings from now
+    // on must wake someone again. Clearing it any later, e.g. after
+    // the futex returns, would let a ring in between set it for good
+    wake_pending_.store(0, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  void cancel_wait() {
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // sleep until the doorbell rings, or until timeout_usec elapses
+  // (negative means forever); spurious wake-ups are possible
+  void wait(const uint32_t ticket, const int64_t timeout_usec = -1) {
+    struct timespec ts;
+    if (timeout_usec >= 0) {
+      ts.tv_sec = timeout_usec / 1000000;
+      ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+    }
+    // EINTR, EAGAIN (the epoch already moved) and ETIMEDOUT are all
+    // fine here, the caller re-checks its condition anyway
+    (void) syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, ticket,
+                   timeout_usec >= 0 ? &ts : NULL, NULL, 0);
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // wake up one sleeping consumer, if any
+  void ring() { ring_n(1); }
+  // wake up all sleeping consumers
+  void ring_all() { ring_n(INT_MAX); }
+
+ private:
+  std::atomic<uint32_t> epoch_;
+  std::atomic<uint32_t> waiters_;
+  // set once a single wake-up has been issued, and cleared by the next
+  // prepare_wait(), before the consumer re-checks the condition
+  std::atomic<uint32_t> wake_pending_;
+
+  void ring_n(const int n) {
+    // pairs with the fence in prepare_wait(): either the consumer sees
+    // the data published before this call, or this call sees the
+    // consumer as a waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiters_.load(std::memory_order_relaxed))
+      return;
+    // a consumer has been woken up but has not run yet: it will see
+    // the new data anyway, no need for another syscall
+    if (n == 1 && (wake_pending_.load(std::memory_order_relaxed) ||
+                   wake_pending_.exchange(1, std::memory_order_seq_cst)))
+      return;
+
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    (void) syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, n,
+                   NULL, NULL, 0);
+  }
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,869 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/es_bulk.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h> // for usleep
+
+// backoff before retrying failed items; doubles on every attempt
+#define BULK_RETRY_BACKOFF_USEC (100 * 1000)
+#define BULK_RETRY_BACKOFF_MAX_USEC (5 * 1000 * 1000)
+// backoff before replaying the spool; doubles on every failure
+#define SPOOL_REPLAY_BACKOFF_MIN_USEC (1000 * 1000)
+#define SPOOL_REPLAY_BACKOFF_MAX_USEC (60 * 1000 * 1000)
+// longest wait for network activity in a single poll(), so that new
+// documents are not held back for long
+#define ES_POLL_SLICE_MSEC 5
+// how often to check whether the index of held requests is ready, and
+// how long to hold them at most
+#define ES_INDEX_HOLD_POLL_USEC (100 * 1000)
+#define ES_INDEX_HOLD_MAX_USEC (60 * 1000 * 1000)
+// at most this many requests per in-flight slot may wait for their
+// index, and as many for their retry backoff; the rest are given up
+#define ES_MAX_PARKED_PER_SLOT 4
+
+namespace freud {
+namespace lib {
+
+namespace {
+
+const char* skip_ws(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    ++p;
+  return p;
+}
+
+// p points to the opening quote; returns a pointer past the closing
+// one, or NULL
+const char* skip_string(const char *p, const char *end) {
+  for (++p; p < end; ++p) {
+    if (*p == '\\')
+      ++p;
+    else if (*p == '"')
+      return p + 1;
+  }
+  return NULL;
+}
+
+// returns a pointer past the value starting at p, or NULL
+const char* skip_value(const char *p, const char *end) {
+  if (p >= end)
+    return NULL;
+
+  if (*p == '"')
+    return skip_string(p, end);
+
+  if (*p == '{' || *p == '[') {
+    int depth = 0;
+    while (p < end) {
+      if (*p == '"') {
+        p = skip_string(p, end);
+        if (!p)
+          return NULL;
+        continue;
+      }
+      if (*p == '{' || *p == '[')
+        ++depth;
+      else if ((*p == '}' || *p == ']') && --depth == 0)
+        return p + 1;
+      ++p;
+    }
+    return NULL;
+  }
+
+  // number, true, false or null
+  while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+         *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+    ++p;
+  return p;
+}
+
+bool key_equals(const char *key, const char *key_end, const char *expected) {
+  // key and key_end include the quotes
+  const size_t len = strlen(expected);
+  return (size_t) (key_end - key) == len + 2 && memcmp(key + 1, expected, len) == 0;
+}
+
+// p points to the opening brace of an object; calls fn(key, key_end,
+// value) for every member, and returns a pointer past the closing
+// brace, or NULL
+template <typename F>
+const char* for_each_member(const char *p, const char *end, F fn) {
+  if (p >= end || *p != '{')
+    return NULL;
+
+  p = skip_ws(p + 1, end);
+  if (p < end && *p == '}')
+    return p + 1;
+
+  while (p < end) {
+    if (*p != '"')
+      return NULL;
+    const char *key = p;
+    p = skip_string(p, end);
+    if (!p)
+      return NULL;
+    const char *key_end = p;
+
+    p = skip_ws(p, end);
+    if (p >= end || *p != ':')
+      return NULL;
+    p = fn(key, key_end, skip_ws(p + 1, end));
+    if (!p)
+      return NULL;
+
+    p = skip_ws(p, end);
+    if (p < end && *p == '}')
+      return p + 1;
+    if (p >= end || *p != ',')
+      return NULL;
+    p = skip_ws(p + 1, end);
+  }
+  return NULL;
+}
+
+} // namespace
+
+bool parse_bulk_response(const char *data, const size_t len, bool *errors, std::vector<int> *statuses) {
+  const char *end = data + len;
+  bool errors_found = false;
+  bool done = false;
+  *errors = false;
+  statuses->clear();
+
+  // the members we need are expected in the order ES emits them,
+  // i.e. "errors" before "items"
+  const char *p = for_each_member(skip_ws(data, end), end, [&](const char *key, const char *key_end,
+                                                                const char *value) -> const char* {
+    if (key_equals(key, key_end, "errors")) {
+      errors_found = true;
+      if (end - value >= 4 && memcmp(value, "true", 4) == 0) {
+        *errors = true;
+        return value + 4;
+      }
+      if (end - value >= 5 && memcmp(value, "false", 5) == 0) {
+        // no need to look at single items, stop scanning
+        done = true;
+        return NULL;
+      }
+      return NULL;
+    }
+
+    if (!key_equals(key, key_end, "items"))
+      return skip_value(value, end);
+
+    // "items": [ { "<action>": { ..., "status": N, ... } }, ... ]
+    if (value >= end || *value != '[')
+      return NULL;
+    const char *q = skip_ws(value + 1, end);
+    if (q < end && *q == ']')
+      return q + 1;
+    while (q < end) {
+      int status = -1;
+      q = for_each_member(q, end, [&](const char *, const char *, const char *action) -> const char* {
+        return for_each_member(action, end, [&](const char *k, const char *k_end, const char *v) -> const char* {
+          if (!key_equals(k, k_end, "status"))
+            return skip_value(v, end);
+          char *v_end = NULL;
+          status = strtol(v, &v_end, 10);
+          return v_end == v ? NULL : v_end;
+        });
+      });
+      if (!q)
+        return NULL;
+      statuses->push_back(status);
+
+      q = skip_ws(q, end);
+      if (q < end && *q == ']')
+        return q + 1;
+      if (q >= end || *q != ',')
+        return NULL;
+      q = skip_ws(q + 1, end);
+    }
+    return NULL;
+  });
+
+  return done || (p && errors_found);
+}
+
+ElasticSearchBulkWriter::ElasticSearchBulkWriter(const std::vector<std::string> &base_addresses,
+                                                 const Configurator &config,
+                                                 ElasticSearchIndexLifecycle *lifecycle)
+    : max_bytes_(config.get_es_bulk_max_bytes()), linger_usec_(config.get_es_bulk_linger_msec() * 1000L),
+      max_retries_(config.get_es_bulk_max_retries()), max_inflight_(config.get_es_max_inflight()),
+      timeout_msec_(config.get_es_bulk_timeout_msec()), controller_(config),
+      nodes_(base_addresses,
+             config.get_es_balance_least_outstanding() ? ElasticSearchNodes::BALANCE_LEAST_OUTSTANDING
+                                                       : ElasticSearchNodes::BALANCE_ROUND_ROBIN,
+             config.get_es_node_max_failures(), config.get_es_node_eject_msec()),
+      lifecycle_(lifecycle), headers_(NULL), gzip_headers_(NULL), gzip_level_(config.get_es_gzip_level()),
+      gzip_min_bytes_(config.get_es_gzip_min_bytes()), unsettled_replay_id_(INT64_MAX), spool_(NULL),
+      replay_waits_index_(false), ts_replay_not_before_(0),
+      replay_backoff_usec_(SPOOL_REPLAY_BACKOFF_MIN_USEC), draining_(false),
+      inflight_(0), requests_(0), request_bytes_(0), docs_sent_(0), docs_retried_(0), docs_failed_(0),
+      docs_spooled_(0), docs_replayed_(0), docs_held_(0), spool_bytes_(0),
+      gzip_bodies_(0), gzip_bytes_in_(0), gzip_bytes_out_(0), gzip_cpu_usec_(0) {
+  if (config.get_es_spool_max_bytes())
+    spool_ = new ElasticSearchSpool(config.get_database_directory() + "/es-spool",
+                                    config.get_es_spool_max_bytes(), config.get_es_spool_segment_bytes());
+
+  headers_ = curl_slist_append(headers_, "Content-Type: application/x-ndjson");
+  // do not wait for a 100-continue round trip before sending the body
+  headers_ = curl_slist_append(headers_, "Expect:");
+
+  if (gzip_level_) {
+    gzip_headers_ = curl_slist_append(gzip_headers_, "Content-Type: application/x-ndjson");
+    gzip_headers_ = curl_slist_append(gzip_headers_, "Content-Encoding: gzip");
+    gzip_headers_ = curl_slist_append(gzip_headers_, "Expect:");
+
+    // the same stream is reset for every body; 16 + 15 selects a gzip
+    // wrapper with the largest window
+    memset(&zstream_, 0, sizeof(zstream_));
+    if (deflateInit2(&zstream_, gzip_level_, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      fprintf(stderr, "WARNING: failed to set up gzip compression, ES bodies will be sent uncompressed\n");
+      curl_slist_free_all(gzip_headers_);
+      gzip_headers_ = NULL;
+    }
+  }
+
+  // connections are cached by the multi handle, per node, and kept
+  // alive across requests; one per request in flight is enough, and
+  // any node might get all of them while the others are ejected
+  multi_ = curl_multi_init();
+  curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_inflight_);
+  curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, (long) (max_inflight_ * nodes_.get_count()));
+}
+
+ElasticSearchBulkWriter::~ElasticSearchBulkWriter() {
+  flush_all();
+
+  // replays that did not complete are left in the spool, for next time
+  for (Request *req : replays_)
+    recycle(req);
+  delete spool_;
+
+  for (Request *req : spare_) {
+    curl_easy_cleanup(req->handle);
+    delete req;
+  }
+  curl_multi_cleanup(multi_);
+  curl_slist_free_all(headers_);
+  if (gzip_headers_) {
+    deflateEnd(&zstream_);
+    curl_slist_free_all(gzip_headers_);
+  }
+}
+
+bool ElasticSearchBulkWriter::init() {
+  if (!spool_)
+    return true;
+
+  if (!spool_->init()) {
+    fprintf(stderr, "WARNING: ES spool disabled, undeliverable documents will be dropped\n");
+    delete spool_;
+    spool_ = NULL;
+    return false;
+  }
+
+  spool_bytes_.store(spool_->get_bytes(), std::memory_order_relaxed);
+  return true;
+}
+
+void ElasticSearchBulkWriter::add(const std::string &index_name, const std::string &type,
+                                  const std::string &document, const char *id, const int64_t replay_id) {
+  Batch &batch = batches_[index_name];
+  if (batch.items.empty())
+    batch.ts_first = get_monotonic_usec();
+  if (replay_id && !batch.replay_id) {
+    batch.replay_id = replay_id;
+    replay_ids_.insert(replay_id);
+    publish_replay_id();
+  }
+
+  // the index is implied by the URL
+  batch.items.push_back(batch.body.size());
+  batch.body += "{\"index\":{\"_type\":\"";
+  batch.body += type;
+  if (id) {
+    batch.body += "\",\"_id\":\"";
+    batch.body += id;
+  }
+  batch.body += "\"}}\n";
+  batch.body += document;
+  batch.body += '\n';
+
+  if (batch.body.size() < max_bytes_ && batch.items.size() < controller_.get_batch_docs())
+    return;
+
+  if (batch.body.size() < max_bytes_)
+    controller_.batch_limited();
+  submit(index_name, &batch);
+
+  // if ES cannot keep up, push back on the sink queue rather than
+  // buffering requests without bounds: once a full window is in flight
+  // and another one waits for it. Requests held for their index or for
+  // a retry do not count, they may wait for a long time and are bounded
+  // on their own
+  while (get_busy_count() >= 2 * controller_.get_inflight_limit())
+    wait_for_progress();
+}
+
+int64_t ElasticSearchBulkWriter::poll(const bool wait) {
+  if (wait && inflight_.load(std::memory_order_relaxed)) {
+    // sleep until some connection is ready, or for a short slice
+    (void) curl_multi_wait(multi_, NULL, 0, ES_POLL_SLICE_MSEC, NULL);
+  }
+
+  int running;
+  curl_multi_perform(multi_, &running);
+  reap_completed();
+
+  const int64_t now = get_monotonic_usec();
+  int64_t next = flush_expired(now);
+  start_requests(now);
+
+  if (inflight_.load(std::memory_order_relaxed))
+    // come back as soon as the caller is idle
+    return 0;
+
+  for (const Request *req : retries_) {
+    const int64_t due = req->ts_not_before > now ? req->ts_not_before - now : 0;
+    if (next < 0 || due < next)
+      next = due;
+  }
+  if ((!held_.empty() || replay_waits_index_) && (next < 0 || next > ES_INDEX_HOLD_POLL_USEC))
+    next = ES_INDEX_HOLD_POLL_USEC;
+  if (spool_ && !draining_ && !spool_->is_empty()) {
+    const int64_t due = ts_replay_not_before_ > now ? ts_replay_not_before_ - now : 0;
+    if (next < 0 || due < next)
+      next = due;
+  }
+  return next;
+}
+
+void ElasticSearchBulkWriter::flush_all() {
+  // whatever is still spooled waits for the next run
+  draining_ = true;
+
+  for (auto &iter : batches_)
+    if (!iter.second.items.empty())
+      submit(iter.first, &iter.second);
+  batches_.clear();
+
+  while (inflight_.load(std::memory_order_relaxed) || get_queued_count())
+    wait_for_progress();
+}
+
+void ElasticSearchBulkWriter::wait_for_progress() {
+  const int64_t next = poll(true);
+  if (!inflight_.load(std::memory_order_relaxed) && next > 0)
+    // nothing on the network, only retries waiting for their backoff
+    usleep(next);
+}
+
+void ElasticSearchBulkWriter::dump_stats(FILE *fp) const {
+  fprintf(fp, "STATS: ES bulk: %" PRIu64 " requests, %" PRIu64 " bytes, %" PRIu64 " docs sent, %" PRIu64
+          " docs retried, %" PRIu64 " docs failed, %" PRIu64 " docs held for index creation\n",
+          requests_.load(), request_bytes_.load(), docs_sent_.load(), docs_retried_.load(), docs_failed_.load(),
+          docs_held_.load());
+  fprintf(fp, "STATS: ES bulk: %u requests in flight, limit %u\n", inflight_.load(),
+          controller_.get_inflight_limit());
+  controller_.dump_stats(fp);
+  nodes_.dump_stats(fp);
+  if (gzip_headers_)
+    fprintf(fp, "STATS: ES gzip: %" PRIu64 " bodies, %" PRIu64 " bytes in, %" PRIu64 " bytes out, %" PRIu64
+            " usec CPU\n",
+            gzip_bodies_.load(), gzip_bytes_in_.load(), gzip_bytes_out_.load(), gzip_cpu_usec_.load());
+  if (spool_)
+    fprintf(fp, "STATS: ES spool: %" PRIu64 " bytes, limit %" PRIu64 ", %" PRIu64 " docs spooled, %" PRIu64
+            " docs replayed\n",
+            spool_bytes_.load(), spool_->get_max_bytes(), docs_spooled_.load(), docs_replayed_.load());
+}
+
+ElasticSearchBulkWriter::Request* ElasticSearchBulkWriter::get_request() {
+  if (spare_.empty())
+    return new Request();
+
+  Request *req = spare_.back();
+  spare_.pop_back();
+  return req;
+}
+
+void ElasticSearchBulkWriter::recycle(Request *req) {
+  if (req->replay_id) {
+    replay_ids_.erase(replay_ids_.find(req->replay_id));
+    req->replay_id = 0;
+    publish_replay_id();
+  }
+  req->from_spool = false;
+  req->inflight = false;
+  req->done = false;
+  spare_.push_back(req);
+}
+
+void ElasticSearchBulkWriter::publish_replay_id() {
+  unsettled_replay_id_.store(replay_ids_.empty() ? INT64_MAX : *replay_ids_.begin(), std::memory_order_release);
+}
+
+void ElasticSearchBulkWriter::submit(const std::string &index_name, Batch *batch) {
+  Request *req = get_request();
+  req->index_name = index_name;
+  req->path = index_name + "/_bulk";
+  // the batch is free to accumulate again, and each keeps the other's
+  // capacity
+  req->body.swap(batch->body);
+  req->items.swap(batch->items);
+  batch->body.clear();
+  batch->items.clear();
+  req->replay_id = batch->replay_id;
+  batch->replay_id = 0;
+  req->attempt = 0;
+  req->ts_not_before = 0;
+
+  if (spool_ && spool_->has_unread()) {
+    // older documents are still waiting in the spool, stay behind them;
+    // once they are all being replayed, the lag is bounded by the
+    // in-flight limit, and new documents go straight to ES again
+    spool(req);
+    return;
+  }
+
+  const int64_t now = get_monotonic_usec();
+  if (lifecycle_ && !lifecycle_->is_ready(index_name)) {
+    // sending now would let ES create the index, with the wrong mappings
+    lifecycle_->ensure(index_name);
+    if (held_.size() >= max_inflight_ * ES_MAX_PARKED_PER_SLOT) {
+      give_up(req, "too many requests are waiting for their index");
+      return;
+    }
+    req->ts_held = now;
+    docs_held_.fetch_add(req->items.size(), std::memory_order_relaxed);
+    held_.push_back(req);
+    return;
+  }
+
+  pending_.push_back(req);
+  start_requests(now);
+}
+
+void ElasticSearchBulkWriter::spool(Request *req) {
+  if (spool_->is_empty()) {
+    // give ES some time before trying again
+    replay_backoff_usec_ = SPOOL_REPLAY_BACKOFF_MIN_USEC;
+    ts_replay_not_before_ = get_monotonic_usec() + replay_backoff_usec_;
+  }
+
+  if (spool_->append(req->index_name, req->body, req->items.size())) {
+    docs_spooled_.fetch_add(req->items.size(), std::memory_order_relaxed);
+  } else {
+    docs_failed_.fetch_add(req->items.size(), std::memory_order_relaxed);
+    fprintf(stderr, "ERROR: ES spool full, dropping %zu document(s) for index [%s]\n",
+            req->items.size(), req->index_name.c_str());
+  }
+  spool_bytes_.store(spool_->get_bytes(), std::memory_order_relaxed);
+  recycle(req);
+}
+
+void ElasticSearchBulkWriter::give_up(Request *req, const char *why) {
+  if (spool_) {
+    spool(req);
+    return;
+  }
+
+  docs_failed_.fetch_add(req->items.size(), std::memory_order_relaxed);
+  fprintf(stderr, "ERROR: giving up on %zu document(s) for index [%s], %s\n",
+          req->items.size(), req->index_name.c_str(), why);
+  recycle(req);
+}
+
+void ElasticSearchBulkWriter::release_held(const int64_t now) {
+  for (size_t i = 0; i < held_.size();) {
+    Request *req = held_[i];
+    if (lifecycle_->is_ready(req->index_name)) {
+      pending_.push_back(req);
+    } else if ((draining_ && spool_) || now - req->ts_held >= ES_INDEX_HOLD_MAX_USEC) {
+      give_up(req, "its index could not be created");
+    } else {
+      ++i;
+      continue;
+    }
+    held_.erase(held_.begin() + i);
+  }
+}
+
+void ElasticSearchBulkWriter::start_replay(const int64_t now) {
+  replay_waits_index_ = false;
+  const uint32_t limit = controller_.get_inflight_limit();
+  if (!spool_ || draining_ || now < ts_replay_not_before_ || inflight_.load(std::memory_order_relaxed) >= limit)
+    return;
+
+  while (replays_.size() < limit && spool_->has_unread()) {
+    Request *req = get_request();
+    uint32_t item_count;
+    if (!spool_->read_next(&req->index_name, &req->body, &item_count)) {
+      recycle(req);
+      break;
+    }
+
+    index_items(req->body, &req->items);
+    if (req->items.size() != item_count)
+      fprintf(stderr, "WARNING: ES spool payload for index [%s] holds %zu item(s), expected %u\n",
+              req->index_name.c_str(), req->items.size(), item_count);
+    req->path = req->index_name + "/_bulk";
+    req->attempt = 0;
+    req->from_spool = true;
+    replays_.push_back(req);
+  }
+
+  for (size_t i = 0; i < replays_.size() && inflight_.load(std::memory_order_relaxed) < limit; ++i) {
+    Request *req = replays_[i];
+    if (req->inflight || req->done)
+      continue;
+
+    if (lifecycle_ && !lifecycle_->is_ready(req->index_name)) {
+      // spooled documents can be days old, their index might be long gone
+      lifecycle_->ensure(req->index_name);
+      replay_waits_index_ = true;
+      continue;
+    }
+
+    req->inflight = true;
+    start(req);
+  }
+}
+
+void ElasticSearchBulkWriter::pop_replays() {
+  while (!replays_.empty() && replays_.front()->done) {
+    spool_->pop();
+    recycle(replays_.front());
+    replays_.pop_front();
+  }
+  spool_bytes_.store(spool_->get_bytes(), std::memory_order_relaxed);
+}
+
+void ElasticSearchBulkWriter::start_requests(const int64_t now) {
+  const uint32_t limit = controller_.get_inflight_limit();
+
+  if (!held_.empty())
+    release_held(now);
+
+  // retries first, they are older; then the spool
+  for (size_t i = 0; i < retries_.size() && inflight_.load(std::memory_order_relaxed) < limit;) {
+    if (retries_[i]->ts_not_before > now) {
+      ++i;
+      continue;
+    }
+    start(retries_[i]);
+    retries_.erase(retries_.begin() + i);
+  }
+
+  start_replay(now);
+
+  while (!pending_.empty() && inflight_.load(std::memory_order_relaxed) < limit) {
+    start(pending_.front());
+    pending_.pop_front();
+  }
+  if (!pending_.empty())
+    controller_.inflight_limited();
+}
+
+void ElasticSearchBulkWriter::start(Request *req) {
+  if (!req->handle) {
+    req->handle = curl_easy_init();
+    curl_easy_setopt(req->handle, CURLOPT_POST, 1);
+    curl_easy_setopt(req->handle, CURLOPT_ERRORBUFFER, req->errbuf);
+    curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, ElasticSearchBulkWriter::curl_append_cb);
+    curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, &req->response);
+    curl_easy_setopt(req->handle, CURLOPT_PRIVATE, req);
+    // 0 means no timeout
+    curl_easy_setopt(req->handle, CURLOPT_TIMEOUT_MS, (long) timeout_msec_);
+  }
+
+  req->node = nodes_.acquire(get_monotonic_usec());
+  req->url = nodes_.get_address(req->node);
+  req->url += req->path;
+
+  // retries are compressed again, as their bodies shrink
+  const std::string *payload = &req->body;
+  if (gzip_headers_ && req->body.size() >= gzip_min_bytes_ && compress(req))
+    payload = &req->compressed;
+
+  req->errbuf[0] = '\0';
+  req->response.clear();
+  curl_easy_setopt(req->handle, CURLOPT_URL, req->url.c_str());
+  curl_easy_setopt(req->handle, CURLOPT_HTTPHEADER, payload == &req->body ? headers_ : gzip_headers_);
+  curl_easy_setopt(req->handle, CURLOPT_POSTFIELDS, payload->data());
+  curl_easy_setopt(req->handle, CURLOPT_POSTFIELDSIZE, (long) payload->size());
+
+  req->ts_started = get_monotonic_usec();
+  requests_.fetch_add(1, std::memory_order_relaxed);
+  request_bytes_.fetch_add(payload->size(), std::memory_order_relaxed);
+  inflight_.fetch_add(1, std::memory_order_relaxed);
+  curl_multi_add_handle(multi_, req->handle);
+}
+
+bool ElasticSearchBulkWriter::compress(Request *req) {
+  const int64_t cpu_begin = get_thread_cpu_usec();
+  if (deflateReset(&zstream_) != Z_OK)
+    return false;
+
+  std::string &out = req->compressed;
+  out.resize(deflateBound(&zstream_, req->body.size()));
+  zstream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(req->body.data()));
+  zstream_.avail_in = req->body.size();
+  zstream_.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zstream_.avail_out = out.size();
+  // the bound guarantees a single call is enough
+  if (deflate(&zstream_, Z_FINISH) != Z_STREAM_END) {
+    fprintf(stderr, "WARNING: gzip compression failed, sending the ES body uncompressed\n");
+    return false;
+  }
+  out.resize(zstream_.total_out);
+
+  gzip_bodies_.fetch_add(1, std::memory_order_relaxed);
+  gzip_bytes_in_.fetch_add(req->body.size(), std::memory_order_relaxed);
+  gzip_bytes_out_.fetch_add(out.size(), std::memory_order_relaxed);
+  gzip_cpu_usec_.fetch_add(get_thread_cpu_usec() - cpu_begin, std::memory_order_relaxed);
+  return true;
+}
+
+void ElasticSearchBulkWriter::reap_completed() {
+  CURLMsg *msg;
+  int msgs_left;
+  while ((msg = curl_multi_info_read(multi_, &msgs_left))) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    Request *req = NULL;
+    long status = 0;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &req);
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+    const CURLcode res = msg->data.result;
+
+    // msg is invalid past this call
+    curl_multi_remove_handle(multi_, req->handle);
+    inflight_.fetch_sub(1, std::memory_order_relaxed);
+    // a node that answers, even with item failures or 429s, is alive
+    nodes_.release(req->node, res == CURLE_OK && status < 500, get_monotonic_usec());
+    complete(req, res, status);
+  }
+}
+
+void ElasticSearchBulkWriter::complete(Request *req, const CURLcode res, const long status) {
+  retry_.clear();
+  size_t sent = 0;
+  size_t failed = 0;
+  ElasticSearchBulkController::Outcome outcome = ElasticSearchBulkController::OUTCOME_OK;
+
+  if (res != CURLE_OK) {
+    // including timeouts
+    outcome = ElasticSearchBulkController::OUTCOME_FAILED;
+    fprintf(stderr, "ERROR: curl perform failed at URL[%s]: %d(%s), %s\n",
+            req->url.c_str(),
+            res, curl_easy_strerror(res),
+            // errbuf might not have been populated
+            req->errbuf[0] ? req->errbuf : "");
+    for (size_t i = 0; i < req->items.size(); ++i)
+      retry_.push_back(i);
+  } else if (status == 200) {
+    bool errors;
+    if (!parse_bulk_response(req->response.data(), req->response.size(), &errors, &statuses_)) {
+      // ES took the request, do not risk duplicates by retrying it
+      fprintf(stderr, "WARNING: malformed ES bulk response from URL[%s]\n", req->url.c_str());
+      sent = req->items.size();
+    } else if (!errors) {
+      sent = req->items.size();
+    } else {
+      for (size_t i = 0; i < req->items.size(); ++i) {
+        const int item_status = i < statuses_.size() ? statuses_[i] : -1;
+        if (item_status >= 200 && item_status < 300)
+          ++sent;
+        else if (is_retryable(item_status))
+          retry_.push_back(i);
+        else
+          ++failed;
+        if (item_status == 429)
+          outcome = ElasticSearchBulkController::OUTCOME_THROTTLED;
+      }
+      if (failed)
+        // e.g. mapping errors: retrying would not help
+        fprintf(stderr, "WARNING: ES rejected %zu document(s) for index [%s]\n", failed, req->index_name.c_str());
+    }
+  } else if (is_retryable(status)) {
+    outcome = status == 429 ? ElasticSearchBulkController::OUTCOME_THROTTLED
+                            : ElasticSearchBulkController::OUTCOME_FAILED;
+    for (size_t i = 0; i < req->items.size(); ++i)
+      retry_.push_back(i);
+  } else {
+    failed = req->items.size();
+    fprintf(stderr, "ERROR: ES bulk request to URL[%s] failed with HTTP status %ld, dropping %zu document(s)\n",
+            req->url.c_str(), status, req->items.size());
+  }
+
+  docs_sent_.fetch_add(sent, std::memory_order_relaxed);
+  docs_failed_.fetch_add(failed, std::memory_order_relaxed);
+
+  const int64_t now = get_monotonic_usec();
+  controller_.record(now - req->ts_started, outcome, now);
+
+  if (req->from_spool) {
+    docs_replayed_.fetch_add(sent, std::memory_order_relaxed);
+    req->inflight = false;
+    if (retry_.empty()) {
+      // on to the next payloads right away
+      req->done = true;
+      pop_replays();
+      replay_backoff_usec_ = SPOOL_REPLAY_BACKOFF_MIN_USEC;
+      return;
+    }
+
+    // ES is not healthy yet; keep the payload in the spool, minus what
+    // got through, and back off
+    compact_for_retry(req);
+    ts_replay_not_before_ = get_monotonic_usec() + replay_backoff_usec_;
+    replay_backoff_usec_ *= 2;
+    if (replay_backoff_usec_ > SPOOL_REPLAY_BACKOFF_MAX_USEC)
+      replay_backoff_usec_ = SPOOL_REPLAY_BACKOFF_MAX_USEC;
+    return;
+  }
+
+  if (!retry_.empty() && req->attempt >= max_retries_) {
+    if (spool_) {
+      compact_for_retry(req);
+      spool(req);
+      // keep newer requests behind this one
+      while (!pending_.empty()) {
+        spool(pending_.front());
+        pending_.pop_front();
+      }
+      for (Request *held : held_)
+        spool(held);
+      held_.clear();
+      return;
+    }
+
+    docs_failed_.fetch_add(retry_.size(), std::memory_order_relaxed);
+    fprintf(stderr, "ERROR: giving up on %zu document(s) for index [%s] after %u retries\n",
+            retry_.size(), req->index_name.c_str(), req->attempt);
+    retry_.clear();
+  }
+
+  if (retry_.empty()) {
+    recycle(req);
+    return;
+  }
+
+  compact_for_retry(req);
+  if (retries_.size() >= max_inflight_ * ES_MAX_PARKED_PER_SLOT) {
+    give_up(req, "too many requests are waiting to be retried");
+    return;
+  }
+  docs_retried_.fetch_add(retry_.size(), std::memory_order_relaxed);
+
+  int64_t backoff = ((int64_t) BULK_RETRY_BACKOFF_USEC) << req->attempt;
+  if (backoff > BULK_RETRY_BACKOFF_MAX_USEC)
+    backoff = BULK_RETRY_BACKOFF_MAX_USEC;
+  ++req->attempt;
+  req->ts_not_before = get_monotonic_usec() + backoff;
+  retries_.push_back(req);
+}
+
+void ElasticSearchBulkWriter::compact_for_retry(Request *req) {
+  // items are moved towards the front, in order, so the body can be
+  // compacted in place
+  std::string &body = req->body;
+  std::vector<size_t> &items = req->items;
+  size_t out = 0;
+  for (size_t r = 0; r < retry_.size(); ++r) {
+    const size_t i = retry_[r];
+    const size_t begin = items[i];
+    const size_t end = i + 1 < items.size() ? items[i + 1] : body.size();
+    if (begin != out)
+      memmove(&body[out], &body[begin], end - begin);
+    items[r] = out;
+    out += end - begin;
+  }
+  body.resize(out);
+  items.resize(retry_.size());
+}
+
+int64_t ElasticSearchBulkWriter::flush_expired(const int64_t now) {
+  int64_t next = -1;
+  for (auto iter = batches_.begin(); iter != batches_.end();) {
+    Batch &batch = iter->second;
+    if (!batch.items.empty() && now - batch.ts_first >= linger_usec_)
+      submit(iter->first, &batch);
+
+    if (batch.items.empty()) {
+      // indices roll over daily, do not keep buffers for stale ones
+      iter = batches_.erase(iter);
+      continue;
+    }
+
+    const int64_t due = batch.ts_first + linger_usec_ - now;
+    if (next < 0 || due < next)
+      next = due;
+    ++iter;
+  }
+
+  return next;
+}
+
+bool ElasticSearchBulkWriter::is_retryable(const long status) {
+  // too many requests, or some server-side trouble (e.g. unavailable shards)
+  return status == 429 || (status >= 500 && status < 600);
+}
+
+void ElasticSearchBulkWriter::index_items(const std::string &body, std::vector<size_t> *items) {
+  // every item is an action line followed by a document line, and
+  // neither holds raw newlines
+  items->clear();
+  bool action = true;
+  size_t begin = 0;
+  for (size_t pos = body.find('\n'); pos != std::string::npos; pos = body.find('\n', pos + 1)) {
+    if (action)
+      items->push_back(begin);
+    else
+      begin = pos + 1;
+    action = !action;
+  }
+}
+
+int64_t ElasticSearchBulkWriter::get_monotonic_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t ElasticSearchBulkWriter::get_thread_cpu_usec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t ElasticSearchBulkWriter::curl_append_cb(void *buffer, size_t size, size_t nmemb, void *userp) {
+  std::string *response = static_cast<std::string*>(userp);
+  response->append(static_cast<const char*>(buffer), size * nmemb);
+  return size * nmemb;
+}
+
+} // namespace lib
+} // namespace freud
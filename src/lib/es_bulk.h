@@ -0,0 +1,248 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include <zlib.h>
+#include "lib/configurator.h"
+#include "lib/es_bulk_controller.h"
+#include "lib/es_lifecycle.h"
+#include "lib/es_nodes.h"
+#include "lib/es_spool.h"
+
+namespace freud {
+namespace lib {
+
+// Parse the response to a _bulk request: sets *errors to the top-level
+// "errors" flag, and, only if that is true, fills statuses with the
+// HTTP status of every item, in request order. Returns false if the
+// response is malformed.
+bool parse_bulk_response(const char *data, const size_t len, bool *errors, std::vector<int> *statuses);
+
+// Accumulates documents as NDJSON, one buffer per index, and ships each
+// buffer through the _bulk endpoint of its index once it grows past a
+// byte size or a document count, or once its oldest document has
+// lingered long enough. Requests are asynchronous: up to a limit of
+// them run concurrently on a curl multi handle, over keep-alive
+// connections, spread over the ES nodes, and the caller drives them
+// through poll(). Every attempt picks its node anew, so that retries
+// fail over to healthy nodes. The document count and the in-flight
+// limit can adapt to the observed latency and errors. Bodies can be
+// gzip-compressed on the way out, reusing a single compressor. Items
+// that fail with a transient error are retried on their own; if they
+// keep failing, they go to a disk spool, if enabled, and so does all
+// new output until the replay, several payloads at a time, has caught
+// up with it: documents have ES-assigned ids, or the same body under a
+// given id, so their order does not matter. Everything else is counted
+// as failed.
+//
+// With a lifecycle, requests are held back until their index has been
+// created with its mappings, for a while at most; then they are handled
+// like requests that kept failing.
+class ElasticSearchBulkWriter {
+ public:
+  ElasticSearchBulkWriter(const std::vector<std::string> &base_addresses, const Configurator &config,
+                          ElasticSearchIndexLifecycle *lifecycle = NULL);
+  ~ElasticSearchBulkWriter();
+
+  // set up the spool, if enabled; without it, requests that keep
+  // failing are dropped
+  bool init();
+
+  // never waits on the network, unless too many requests are already
+  // queued up: then it waits for some of them to complete; without an
+  // id, ES assigns one. Documents replayed from the DB cache carry the
+  // id of their row, in increasing order
+  void add(const std::string &index_name, const std::string &type, const std::string &document,
+           const char *id = NULL, const int64_t replay_id = 0);
+
+  // make progress on the requests in flight, flush the buffers that
+  // lingered long enough, and start queued requests; if wait is true
+  // and requests are in flight, wait a little for network activity.
+  // Returns the usec until the next call is due, or -1 if there is no
+  // work left at all.
+  int64_t poll(const bool wait);
+  // flush all buffers, and wait until every request has completed
+  void flush_all();
+  // wait for at least some request to complete, or retry
+  void wait_for_progress();
+
+  // bytes held by the spool, 0 once it has been replayed; thread-safe
+  uint64_t get_spool_bytes() const { return spool_bytes_.load(std::memory_order_relaxed); }
+
+  // the smallest replay id among the documents not yet sent, spooled
+  // or dropped, or INT64_MAX if there are none; thread-safe
+  int64_t get_unsettled_replay_id() const { return unsettled_replay_id_.load(std::memory_order_acquire); }
+
+  void dump_stats(FILE *fp) const;
+
+ private:
+  struct Batch {
+    Batch() : ts_first(0), replay_id(0) {}
+
+    std::string body;
+    // offset in body where each item (action and document) starts
+    std::vector<size_t> items;
+    int64_t ts_first; // monotonic usec, when the first item was added
+    int64_t replay_id; // the smallest among the items, 0 if none
+  };
+
+  // a single _bulk request, possibly retried several times
+  struct Request {
+    Request()
+        : handle(NULL), node(0), attempt(0), ts_not_before(0), ts_started(0), ts_held(0), replay_id(0),
+          from_spool(false), inflight(false), done(false) {}
+
+    CURL *handle;
+    std::string index_name;
+    std::string path; // relative to the base address of a node
+    size_t node; // of the current attempt
+    std::string url;
+    std::string body;
+    std::vector<size_t> items;
+    std::string compressed; // body, as last sent, if compressed
+    std::string response;
+    char errbuf[CURL_ERROR_SIZE];
+    uint32_t attempt;
+    int64_t ts_not_before; // monotonic usec, for retries
+    int64_t ts_started; // monotonic usec, of the current attempt
+    int64_t ts_held; // monotonic usec, when it started waiting for its index
+    int64_t replay_id; // the smallest among the items, 0 if none; kept until recycled
+    bool from_spool;
+    // spooled payloads only
+    bool inflight;
+    bool done;
+  };
+
+  const uint64_t max_bytes_;
+  const int64_t linger_usec_;
+  const uint32_t max_retries_;
+  const uint32_t max_inflight_;
+  const uint32_t timeout_msec_;
+
+  // current document count and in-flight limits
+  ElasticSearchBulkController controller_;
+
+  ElasticSearchNodes nodes_;
+  // NULL if indices need not be waited for
+  ElasticSearchIndexLifecycle *const lifecycle_;
+  std::map<std::string, Batch> batches_;
+
+  CURLM *multi_;
+  struct curl_slist *headers_;
+  struct curl_slist *gzip_headers_;
+
+  // 0 if compression is disabled
+  const int gzip_level_;
+  const uint64_t gzip_min_bytes_;
+  z_stream zstream_;
+  // requests waiting for their index to be created
+  std::vector<Request*> held_;
+  // requests waiting for a free slot, in order
+  std::deque<Request*> pending_;
+  // requests waiting for their backoff to elapse
+  std::vector<Request*> retries_;
+  // completed requests, kept to reuse their buffers and handles
+  std::vector<Request*> spare_;
+  // the replay ids of the batches and requests that carry replayed
+  // documents; the smallest is published for the DB replayer, which
+  // only moves its persisted position past settled rows
+  std::multiset<int64_t> replay_ids_;
+  std::atomic<int64_t> unsettled_replay_id_;
+  // scratch space reused across completions
+  std::vector<int> statuses_;
+  std::vector<size_t> retry_;
+
+  // spooled payloads read ahead, in spool order, up to the in-flight
+  // limit; they are replayed concurrently, and popped in order once
+  // done with
+  ElasticSearchSpool *spool_;
+  std::deque<Request*> replays_;
+  bool replay_waits_index_; // some replay waits for its index
+  int64_t ts_replay_not_before_; // monotonic usec
+  int64_t replay_backoff_usec_;
+  bool draining_; // shutting down, no more replays
+
+  std::atomic<uint32_t> inflight_;
+  std::atomic<uint64_t> requests_;
+  std::atomic<uint64_t> request_bytes_;
+  std::atomic<uint64_t> docs_sent_;
+  std::atomic<uint64_t> docs_retried_;
+  std::atomic<uint64_t> docs_failed_;
+  std::atomic<uint64_t> docs_spooled_;
+  std::atomic<uint64_t> docs_replayed_;
+  std::atomic<uint64_t> docs_held_;
+  std::atomic<uint64_t> spool_bytes_;
+  std::atomic<uint64_t> gzip_bodies_;
+  std::atomic<uint64_t> gzip_bytes_in_;
+  std::atomic<uint64_t> gzip_bytes_out_;
+  std::atomic<uint64_t> gzip_cpu_usec_;
+
+  Request* get_request();
+  // settles the replayed documents of req, if any
+  void recycle(Request *req);
+  void publish_replay_id();
+  // turn the batch into a request, and queue it
+  void submit(const std::string &index_name, Batch *batch);
+  // move req to the spool, if it has room; req is recycled either way
+  void spool(Request *req);
+  // read spooled payloads ahead and start replaying them, if it is time
+  // to
+  void start_replay(const int64_t now);
+  // pop the payloads done with from the head of the spool
+  void pop_replays();
+  // queue the held requests whose index is ready, and give up on those
+  // that waited too long
+  void release_held(const int64_t now);
+  // spool req if possible, or drop it; req is recycled either way
+  void give_up(Request *req, const char *why);
+  // start as many queued requests as the in-flight limit allows
+  void start_requests(const int64_t now);
+  void start(Request *req);
+  // gzip req->body into req->compressed; returns false on errors
+  bool compress(Request *req);
+  // handle the requests that completed since the last call
+  void reap_completed();
+  void complete(Request *req, const CURLcode res, const long status);
+  // keep only the items listed in retry_, in the body and item list of req
+  void compact_for_retry(Request *req);
+  int64_t flush_expired(const int64_t now);
+  size_t get_queued_count() const { return held_.size() + pending_.size() + retries_.size(); }
+  // requests in flight, or only waiting for a free slot
+  size_t get_busy_count() const { return pending_.size() + inflight_.load(std::memory_order_relaxed); }
+
+  static bool is_retryable(const long status);
+  // rebuild the offsets of the items of a spooled body
+  static void index_items(const std::string &body, std::vector<size_t> *items);
+  static int64_t get_monotonic_usec();
+  static int64_t get_thread_cpu_usec();
+  static size_t curl_append_cb(void *buffer, size_t size, size_t nmemb, void *userp);
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,105 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/es_bulk_controller.h"
+
+#include <inttypes.h>
+#include <algorithm>
+
+// a window closes after this many completions, or after this long,
+// whichever comes first
+#define CONTROLLER_WINDOW_REQUESTS 32
+#define CONTROLLER_WINDOW_USEC (1000 * 1000)
+
+namespace freud {
+namespace lib {
+
+ElasticSearchBulkController::ElasticSearchBulkController(const Configurator &config)
+    : enabled_(config.get_es_adaptive()),
+      min_batch_docs_(std::min(config.get_es_bulk_min_docs(), config.get_es_bulk_max_docs())),
+      max_batch_docs_(config.get_es_bulk_max_docs()),
+      min_inflight_(std::min(config.get_es_min_inflight(), config.get_es_max_inflight())),
+      max_inflight_(config.get_es_max_inflight()),
+      target_p99_usec_(config.get_es_target_p99_msec() * 1000L),
+      // reach the upper bound in about 16 healthy windows
+      batch_step_(std::max(1U, (max_batch_docs_ - min_batch_docs_) / 16)),
+      congested_(false), batch_limited_(false), inflight_limited_(false), ts_window_start_(0),
+      // start where fixed limits would be, back off on trouble, and
+      // probe upwards again once it is gone
+      batch_docs_(max_batch_docs_), inflight_limit_(max_inflight_),
+      last_p99_usec_(0), increases_(0), decreases_(0) {
+  latencies_.reserve(CONTROLLER_WINDOW_REQUESTS);
+}
+
+void ElasticSearchBulkController::record(const int64_t latency_usec, const Outcome outcome, const int64_t now) {
+  if (!enabled_)
+    return;
+
+  if (latencies_.empty())
+    ts_window_start_ = now;
+  latencies_.push_back(latency_usec);
+  if (outcome != OUTCOME_OK)
+    congested_ = true;
+
+  if (latencies_.size() >= CONTROLLER_WINDOW_REQUESTS || now - ts_window_start_ >= CONTROLLER_WINDOW_USEC)
+    end_window();
+}
+
+void ElasticSearchBulkController::dump_stats(FILE *fp) const {
+  if (!enabled_)
+    return;
+
+  fprintf(fp, "STATS: ES adaptive: batch %u docs (%u-%u), %u requests in flight (%u-%u), last p99 %" PRId64
+          " msec (target %" PRId64 "), %" PRIu64 " increases, %" PRIu64 " decreases\n",
+          batch_docs_.load(), min_batch_docs_, max_batch_docs_, inflight_limit_.load(), min_inflight_, max_inflight_,
+          last_p99_usec_.load() / 1000, target_p99_usec_ / 1000, increases_.load(), decreases_.load());
+}
+
+void ElasticSearchBulkController::end_window() {
+  // p99 of a window this small is its largest sample, or close to it
+  const size_t rank = (latencies_.size() * 99) / 100;
+  std::nth_element(latencies_.begin(), latencies_.begin() + rank, latencies_.end());
+  const int64_t p99 = latencies_[rank];
+  last_p99_usec_.store(p99, std::memory_order_relaxed);
+
+  uint32_t batch_docs = batch_docs_.load(std::memory_order_relaxed);
+  uint32_t inflight_limit = inflight_limit_.load(std::memory_order_relaxed);
+  if (congested_ || p99 > target_p99_usec_) {
+    batch_docs = std::max(min_batch_docs_, batch_docs / 2);
+    inflight_limit = std::max(min_inflight_, inflight_limit / 2);
+    decreases_.fetch_add(1, std::memory_order_relaxed);
+  } else if (batch_limited_ || inflight_limited_) {
+    // only grow what is holding traffic back, so that limits do not
+    // drift upwards while idle
+    if (batch_limited_)
+      batch_docs = std::min(max_batch_docs_, batch_docs + batch_step_);
+    if (inflight_limited_)
+      inflight_limit = std::min(max_inflight_, inflight_limit + 1);
+    increases_.fetch_add(1, std::memory_order_relaxed);
+  }
+  batch_docs_.store(batch_docs, std::memory_order_relaxed);
+  inflight_limit_.store(inflight_limit, std::memory_order_relaxed);
+
+  latencies_.clear();
+  congested_ = false;
+  batch_limited_ = false;
+  inflight_limited_ = false;
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,89 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "lib/configurator.h"
+
+namespace freud {
+namespace lib {
+
+// AIMD control of the size of ES bulk requests, in documents, and of the
+// number of requests in flight. Completed requests are looked at in
+// windows: if any of them was throttled (429), failed at the transport
+// level (including timeouts) or with a 5xx, or if the p99 latency went
+// past the target, both limits are halved; otherwise, each limit that
+// was actually holding traffic back grows by a step. Limits stay within
+// their configured bounds, and start from the upper ones, where they
+// stay when control is disabled. Not thread-safe, except for the
+// getters and dump_stats().
+class ElasticSearchBulkController {
+ public:
+  enum Outcome {
+    OUTCOME_OK,
+    OUTCOME_THROTTLED,
+    OUTCOME_FAILED,
+  };
+
+  explicit ElasticSearchBulkController(const Configurator &config);
+  ~ElasticSearchBulkController() = default;
+
+  uint32_t get_batch_docs() const { return batch_docs_.load(std::memory_order_relaxed); }
+  uint32_t get_inflight_limit() const { return inflight_limit_.load(std::memory_order_relaxed); }
+
+  // a batch was flushed because it reached the current size
+  void batch_limited() { batch_limited_ = true; }
+  // a request had to wait for a free slot
+  void inflight_limited() { inflight_limited_ = true; }
+
+  void record(const int64_t latency_usec, const Outcome outcome, const int64_t now);
+
+  void dump_stats(FILE *fp) const;
+
+ private:
+  const bool enabled_;
+  const uint32_t min_batch_docs_;
+  const uint32_t max_batch_docs_;
+  const uint32_t min_inflight_;
+  const uint32_t max_inflight_;
+  const int64_t target_p99_usec_;
+  const uint32_t batch_step_;
+
+  // current window
+  std::vector<int64_t> latencies_;
+  bool congested_;
+  bool batch_limited_;
+  bool inflight_limited_;
+  int64_t ts_window_start_; // monotonic usec
+
+  std::atomic<uint32_t> batch_docs_;
+  std::atomic<uint32_t> inflight_limit_;
+  std::atomic<int64_t> last_p99_usec_;
+  std::atomic<uint64_t> increases_;
+  std::atomic<uint64_t> decreases_;
+
+  void end_window();
+};
+
+} // namespace lib
+} // namespace freud
@@ -18,18 +18,20 @@
 
 #include "lib/es_interface.h"
 
+#include <inttypes.h>
 #include <string.h> // for basename
 #include <time.h> // for gmtime_r
-#include <unistd.h> // for gethostname
 
 namespace freud {
 namespace lib {
 
-ElasticSearchIndexManager::ElasticSearchIndexManager(const std::string &base_address)
-    : base_address_(base_address) {
+ElasticSearchIndexManager::ElasticSearchIndexManager(const std::vector<std::string> &base_addresses,
+                                                     const Configurator &config)
+    : lifecycle_(base_addresses), bulk_writer_(base_addresses, config, &lifecycle_) {
 }
 
-bool ElasticSearchIndexManager::init_index(const std::string &index_name, const std::string &mappings) {
+bool ElasticSearchIndexManager::init_index(const std::string &index_name,
+                                           const ElasticSearchIndexLifecycle::Mappings &mappings) {
   auto index_ptr = indices_.find(index_name);
   if (index_ptr != indices_.end()) {
     // index already present
@@ -39,15 +41,32 @@ bool ElasticSearchIndexManager::init_index(const std::string &index_name, const
 
   indices_.insert(std::pair<std::string, IndexInfo>(index_name,
                                                     IndexInfo(index_name,
-                                                              base_address_,
-                                                              mappings)));
+                                                              &lifecycle_,
+                                                              &bulk_writer_)));
+  lifecycle_.add_index(index_name, mappings);
   fprintf(stderr, "INFO: created new index named [%s]\n", index_name.c_str());
 
   return true;
 }
 
+void ElasticSearchIndexManager::init_static_index(const std::string &index_name,
+                                                  const ElasticSearchIndexLifecycle::Mappings &mappings) {
+  lifecycle_.add_static_index(index_name, mappings);
+  fprintf(stderr, "INFO: created new static index named [%s]\n", index_name.c_str());
+}
+
+void ElasticSearchIndexManager::start() {
+  lifecycle_.start();
+}
+
+void ElasticSearchIndexManager::dump_stats(FILE *fp) const {
+  bulk_writer_.dump_stats(fp);
+  lifecycle_.dump_stats(fp);
+}
+
 bool ElasticSearchIndexManager::send(const std::string &index_name, const std::string &document_name,
-                                     const std::string &postdata, const tm &event_ts) {
+                                     const std::string &postdata, const time_t event_ts,
+                                     const int64_t replay_id) {
   auto index_ptr = indices_.find(index_name);
   if (index_ptr == indices_.end()) {
     // index not found
@@ -55,198 +74,165 @@ bool ElasticSearchIndexManager::send(const std::string &index_name, const std::s
     return false;
   }
 
-  return index_ptr->second.send(document_name, postdata, event_ts);
+  return index_ptr->second.send(document_name, postdata, event_ts, replay_id);
 }
 
-ElasticSearchIndexManager::IndexInfo::IndexInfo(const std::string &name, const std::string &base_post_url,
-                                                const std::string &mappings)
-    : index_name_(name), base_post_url_(base_post_url), mappings_(mappings) {
-  // init timestamp of most recent event
-  ts_last_update_.year_ = 0;
-  ts_last_update_.month_ = 0;
-  ts_last_update_.day_ = 0;
+void ElasticSearchIndexManager::send_static(const std::string &index_name, const std::string &document_name,
+                                            const char *document_id, const std::string &postdata) {
+  bulk_writer_.add(index_name, document_name, postdata, document_id);
 }
 
-bool ElasticSearchIndexManager::IndexInfo::send(const std::string &document_name, const std::string &postdata,
-                                                const tm &event_ts) {
-  const bool flush_needed = update_cached_ts(event_ts);
-  if (flush_needed) {
-    fprintf(stderr, "INFO: flushing all documents under index [%s]\n", index_name_.c_str());
-    for (auto &iter: documents_)
-      delete iter.second;
-    documents_.clear();
-
-    // determine the new date suffix
-    char index_suffix_buf[128];
-    snprintf(index_suffix_buf, sizeof(index_suffix_buf), "-%.4d.%.2d.%.2d",
-             ts_last_update_.year_, ts_last_update_.month_, ts_last_update_.day_);
-
-    // set the new POST url
-    current_post_url_ = base_post_url_ + index_name_ + std::string(index_suffix_buf) + "/";
-    fprintf(stderr, "INFO: index [%s] updated URL to [%s]\n", index_name_.c_str(),
-            current_post_url_.c_str());
-
-    // setup the mappings for the new index name
-    setup_mappings();
+ElasticSearchIndexManager::IndexInfo::IndexInfo(const std::string &name, ElasticSearchIndexLifecycle *lifecycle,
+                                                ElasticSearchBulkWriter *bulk_writer)
+    : index_name_(name), lifecycle_(lifecycle), bulk_writer_(bulk_writer), next_route_(0) {
+  // empty ranges, nothing matches them
+  for (Route &route : routes_) {
+    route.begin = 0;
+    route.end = 0;
   }
-
-  // create document if not already existing
-  auto doc_ptr = documents_.find(document_name);
-  if (doc_ptr == documents_.end()) {
-    // index not found
-    auto retval = documents_.insert(std::pair<std::string, DocInfo*>(document_name,
-                                                                     new DocInfo(document_name,
-                                                                                 current_post_url_ + document_name + "/")));
-    doc_ptr = retval.first;
-
-    fprintf(stderr, "INFO: index [%s] spawned new document [%s] under URL [%s]\n",
-            index_name_.c_str(), document_name.c_str(), current_post_url_.c_str());
-  }
-
-  return doc_ptr->second->send(postdata);
-}
-
-void ElasticSearchIndexManager::IndexInfo::setup_mappings() {
-  char tmp_errbuf[CURL_ERROR_SIZE];
-  CURL *tmp_handle = curl_easy_init();
-  curl_easy_setopt(tmp_handle, CURLOPT_URL, current_post_url_.c_str());
-  curl_easy_setopt(tmp_handle, CURLOPT_POST, 1);
-  curl_easy_setopt(tmp_handle, CURLOPT_ERRORBUFFER, tmp_errbuf);
-  curl_easy_setopt(tmp_handle, CURLOPT_WRITEFUNCTION, ElasticSearchInterface::curl_null_cb);
-  curl_easy_setopt(tmp_handle, CURLOPT_POSTFIELDS, mappings_.c_str());
-  curl_easy_setopt(tmp_handle, CURLOPT_POSTFIELDSIZE, mappings_.size());
-
-  CURLcode res = curl_easy_perform(tmp_handle);
-  if (res != CURLE_OK)
-    fprintf(stderr, "WARNING: ES mapping init failed for index %s: %d(%s), %s\n",
-            index_name_.c_str(),
-            res, curl_easy_strerror(res),
-            // errbuf might not have been populated
-            tmp_errbuf[0] ? tmp_errbuf : "");
-
-  curl_easy_cleanup(tmp_handle);
 }
 
-bool ElasticSearchIndexManager::IndexInfo::update_cached_ts(const tm &event_ts) {
-  const int event_year = 1900 + event_ts.tm_year;
-  const int event_month = 1 + event_ts.tm_mon;
-  const int event_day = event_ts.tm_mday;
-
-  if (event_year > ts_last_update_.year_ ||
-      (event_year == ts_last_update_.year_ && event_month > ts_last_update_.month_) ||
-      (event_year == ts_last_update_.year_ && event_month == ts_last_update_.month_ && event_day > ts_last_update_.day_)) {
-    // update needed
-    ts_last_update_.year_ = event_year;
-    ts_last_update_.month_ = event_month;
-    ts_last_update_.day_ = event_day;
-
-    return true;
-  }
-
-  // no update happened
-  return false;
-}
+bool ElasticSearchIndexManager::IndexInfo::send(const std::string &document_name, const std::string &postdata,
+                                                const time_t event_ts, const int64_t replay_id) {
+  const Route *route = get_route(event_ts);
+  if (!route)
+    return false;
 
-ElasticSearchIndexManager::DocInfo::DocInfo(const std::string &name, const std::string &full_url)
-    : document_name_(name), document_post_url_(full_url) {
-  handle_ = curl_easy_init();
-  curl_easy_setopt(handle_, CURLOPT_URL, document_post_url_.c_str());
-  curl_easy_setopt(handle_, CURLOPT_POST, 1);
-  curl_easy_setopt(handle_, CURLOPT_ERRORBUFFER, errbuf_);
-  // suppress all data output with a null callback
-  curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION, ElasticSearchInterface::curl_null_cb);
-  // DEBUG ONLY
-  //curl_easy_setopt(handle_, CURLOPT_VERBOSE, 1);
+  // documents buffered for other days keep going to their own indices
+  bulk_writer_->add(route->daily_index_name, document_name, postdata, NULL, replay_id);
+  return true;
 }
 
-ElasticSearchIndexManager::DocInfo::~DocInfo() {
-  curl_easy_cleanup(handle_);
-  fprintf(stderr, "INFO: destroyed document [%s] at URL [%s]\n",
-          document_name_.c_str(), document_post_url_.c_str());
-}
+const ElasticSearchIndexManager::IndexInfo::Route*
+ElasticSearchIndexManager::IndexInfo::get_route(const time_t event_ts) {
+  for (const Route &route : routes_)
+    if (event_ts >= route.begin && event_ts < route.end)
+      return &route;
 
-bool ElasticSearchIndexManager::DocInfo::send(const std::string &postdata) {
-  curl_easy_setopt(handle_, CURLOPT_POSTFIELDS, postdata.c_str());
-  curl_easy_setopt(handle_, CURLOPT_POSTFIELDSIZE, postdata.size());
-  CURLcode res = curl_easy_perform(handle_);
-  if (res != CURLE_OK) {
-    fprintf(stderr, "ERROR: curl perform failed at URL[%s]: %d(%s), %s\n",
-            document_post_url_.c_str(),
-            res, curl_easy_strerror(res),
-            // errbuf might not have been populated
-            errbuf_[0] ? errbuf_ : "");
-    return false;
+  // UTC days are exactly 86400 seconds long in Epoch time, leap
+  // seconds are not counted
+  const time_t day_sec = 24 * 3600;
+  const time_t begin = event_ts - (((event_ts % day_sec) + day_sec) % day_sec);
+  struct tm broken_down_time;
+  if (!gmtime_r(&begin, &broken_down_time)) {
+    fprintf(stderr, "ERROR: gmtime_r failed\n");
+    return NULL;
   }
 
-  return true;
+  Route &route = routes_[next_route_];
+  next_route_ = (next_route_ + 1) % ES_ROUTE_CACHE_SIZE;
+  route.begin = begin;
+  route.end = begin + day_sec;
+  route.daily_index_name = ElasticSearchIndexLifecycle::get_daily_name(index_name_, broken_down_time);
+
+  // normally created a day in advance already; if not, e.g. for late
+  // events, it will be created in the background, and the bulk writer
+  // holds its documents back until then
+  lifecycle_->ensure(index_name_, route.daily_index_name);
+  return &route;
 }
 
 ElasticSearchInterface::ElasticSearchInterface(const Configurator &config)
-    : base_address_(config.get_elastic_search_url()), index_name_(config.get_elastic_search_index()),
-      index_manager_(base_address_),
-      send_detailed_reports_(config.fwd_detailed_reports()) {
-  char buf[256];
-  if (gethostname(buf, sizeof(buf)) < 0) {
-    // error case
-    hostname_ = "undefined";
-  } else {
-    // success case
-
-    // man gethostname(2) states that POSIX does not require
-    // gethostname() to raise an error if a name truncation occurred;
-    // hence, to be safe, always put a \0 at the end of the buffer
-    buf[sizeof(buf) - 1] = '\0';
-
-    hostname_ = buf;
-  }
+    : index_name_(config.get_elastic_search_index()),
+      index_manager_(config.get_elastic_search_urls(), config),
+      send_detailed_reports_(config.fwd_detailed_reports()),
+      accept_past_sec_(config.get_es_accept_past_sec()), accept_future_sec_(config.get_es_accept_future_sec()),
+      rejected_past_(0), rejected_future_(0), traces_(NULL),
+      trace_index_name_(config.get_elastic_search_index() + "-traces") {
+  if (config.get_es_trace_interning())
+    traces_ = new TraceDictionary(config.get_es_trace_cache_size());
+}
+
+ElasticSearchInterface::~ElasticSearchInterface() {
+  delete traces_;
 }
 
 bool ElasticSearchInterface::init() {
   // setup the documents in ES if they do not exist; failures should be ignored
   setup_es_documents();
+  index_manager_.start();
+
+  // without a spool, documents are dropped during ES outages; this
+  // should not prevent startup either
+  (void) index_manager_.get_bulk_writer().init();
 
   return true;
 }
 
-bool ElasticSearchInterface::post_packet(const std::string &s) {
-  if (!pkt_post_pb_.ParseFromString(s)) {
-    // parse error
-    fprintf(stderr, "ERROR: parse pb message failed\n");
+bool ElasticSearchInterface::post_packet(const MsgBuffer &msg, const time_t now) {
+  // the dispatcher only forwards messages that parsed successfully
+  const DecodedReport *report = msg.decoded();
+  if (!report) {
+    fprintf(stderr, "ERROR: message was not decoded\n");
     return false;
   }
 
-  if (pkt_post_pb_.type() == freudpb::Report::DETAILED && !send_detailed_reports_)
+  if (report->get_type() == freudpb::Report::DETAILED && !send_detailed_reports_)
     // nothing to do here, we don't want to send this detailed report
     return true;
 
-  const time_t timestamp = pkt_post_pb_.usec_ts() / 1000000; // seconds since Epoch (UTC)
-  struct tm broken_down_time;
-  if (!gmtime_r(&timestamp, &broken_down_time)) {
-    fprintf(stderr, "ERROR: gmtime_r failed\n");
-    return false;
+  // rejects are deliberate, not failures: they are only counted.
+  // Replayed reports are old by design (e.g. a backfill after an ES
+  // outage), and were already accepted once when cached: they bypass
+  // the window
+  const time_t timestamp = report->get_usec_ts() / 1000000; // seconds since Epoch (UTC)
+  if (!msg.is_replayed()) {
+    if (accept_past_sec_ && timestamp < now - accept_past_sec_) {
+      // not worth an index of its own
+      rejected_past_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    if (accept_future_sec_ && timestamp > now + accept_future_sec_) {
+      // most likely a broken clock on the reporting host
+      rejected_future_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
   }
 
-  std::string postdata = pb2json(pkt_post_pb_);
+  char trace_id[17];
+  const bool interned = traces_ && report->get_type() == freudpb::Report::DETAILED &&
+                        report->get_report().trace_size();
+  if (interned)
+    intern_trace(report->get_report(), trace_id, sizeof(trace_id));
+
+  // the buffer is reused, so that serializing does not allocate
+  postdata_.clear();
+  pb2json(*report, interned ? trace_id : NULL, &postdata_);
 
   // select URL destination based on report type
-  switch (pkt_post_pb_.type()) {
+  switch (report->get_type()) {
     case freudpb::Report::SUMMARY:
-      return index_manager_.send(index_name_, "summary-report", postdata, broken_down_time);
+      return index_manager_.send(index_name_, "summary-report", postdata_, timestamp, msg.get_replay_id());
 
     case freudpb::Report::DETAILED:
-      return index_manager_.send(index_name_, "detailed-report", postdata, broken_down_time);
+      return index_manager_.send(index_name_, "detailed-report", postdata_, timestamp, msg.get_replay_id());
   }
 
   return true;
 }
 
-size_t ElasticSearchInterface::curl_null_cb(void * /*buffer*/, size_t size, size_t nmemb, void * /*userp*/) {
-  return size * nmemb;
+size_t ElasticSearchInterface::post_packets(MsgBuffer *const *msgs, const size_t count) {
+  // second granularity is plenty for the acceptance windows
+  const time_t now = time(NULL);
+  size_t posted = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (post_packet(*msgs[i], now))
+      ++posted;
+  return posted;
+}
+
+void ElasticSearchInterface::dump_stats(FILE *fp) const {
+  fprintf(fp, "STATS: ES routing: %" PRIu64 " reports older than the acceptance window, %" PRIu64
+          " reports ahead of it\n", rejected_past_.load(), rejected_future_.load());
+  if (traces_)
+    traces_->dump_stats(fp, "ES trace dictionary");
+  index_manager_.dump_stats(fp);
 }
 
 void ElasticSearchInterface::setup_es_documents() {
   // magic JSON, update accordingly
-  const std::string mappings = "{\"mappings\":{\"summary-report\":{\"properties\":{"
+  ElasticSearchIndexLifecycle::Mappings mappings;
+  mappings["summary-report"] = "{\"properties\":{"
       "\"time\":{\"type\":\"date\",\"format\":\"epoch_millis\"},"
       "\"hostname\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"basename\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
@@ -254,157 +240,133 @@ void ElasticSearchInterface::setup_es_documents() {
       "\"pgname\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"module\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"type\":{\"type\":\"string\",\"index\":\"not_analyzed\"}"
-      "}},\"detailed-report\":{\"properties\":{"
+      "}}";
+  mappings["detailed-report"] = "{\"properties\":{"
       "\"time\":{\"type\":\"date\",\"format\":\"epoch_millis\"},"
       "\"hostname\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"basename\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"procname\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"pgname\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
       "\"module\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
-      "\"type\":{\"type\":\"string\",\"index\":\"not_analyzed\"}"
-      "}}}}";
+      "\"type\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
+      "\"trace_id\":{\"type\":\"string\",\"index\":\"not_analyzed\"}"
+      "}}";
 
   index_manager_.init_index(index_name_, mappings);
-}
 
-std::string ElasticSearchInterface::pb2json(const freudpb::Report &pb) {
-  std::string result = "{ ";
-  append_kv_int32(&result, "pid", pb.pid());
-  result += ", ";
-  append_kv_string(&result, "hostname", hostname_);
-  result += ", ";
-  append_kv_string(&result, "procname", pb.procname());
-  result += ", ";
-  append_kv_string(&result, "basename", basename(pb.procname().c_str()));
-  result += ", ";
-  append_kv_string(&result, "pgname", pb.pgname());
-  result += ", ";
-  append_kv_string(&result, "type", pb.type() == freudpb::Report::SUMMARY ? "summary" : "detailed");
-  result += ", ";
-  // normalize usec to msec (that's what ES expects)
-  append_kv_uint64(&result, "time", pb.usec_ts() / 1000);
-  result += ", ";
-  append_kv_string(&result, "module", pb.module_name());
-  result += ", ";
-  if (pb.type() == freudpb::Report::DETAILED) {
-    append_kv_uint64(&result, "instance", pb.instance_id());
-    result += ", ";
+  if (traces_) {
+    ElasticSearchIndexLifecycle::Mappings trace_mappings;
+    trace_mappings["trace"] = "{\"properties\":{"
+        "\"trace_id\":{\"type\":\"string\",\"index\":\"not_analyzed\"},"
+        "\"time\":{\"type\":\"date\",\"format\":\"epoch_millis\"}"
+        "}}";
+
+    index_manager_.init_static_index(trace_index_name_, trace_mappings);
   }
+}
+
+void ElasticSearchInterface::intern_trace(const freudpb::Report &pb, char *trace_id, const size_t trace_id_len) {
+  const uint64_t id = TraceDictionary::hash(pb.trace().data(), pb.trace_size());
+  snprintf(trace_id, trace_id_len, "%.16" PRIx64, id);
+  if (!traces_->insert(id))
+    // sent recently
+    return;
+
+  // the id doubles as document id, so that traces sent again after
+  // being evicted, or by another run, overwrite themselves
+  tracedata_.clear();
+  JsonWriter json(&tracedata_);
+  json.begin_object();
+  json.key("trace_id");
+  json.value_string(trace_id);
+  // when the trace was first seen, by this run
+  json.key("time");
+  json.value_uint(pb.usec_ts() / 1000);
+  json.key("trace");
+  json.begin_array();
+  for (const uint64_t &t : pb.trace())
+    json.value_uint(t);
+  json.end_array();
+  json.end_object();
+
+  index_manager_.send_static(trace_index_name_, "trace", trace_id, tracedata_);
+}
 
-  // if not a summary, append array of traces
-  if (pb.type() == freudpb::Report::DETAILED) {
-    result += "\"trace\": [";
-    bool first = true;
-    for (const uint64_t &t : pb.trace()) {
-      if (first)
-        result += " ";
-      else
-        result += ", ";
-      result += std::to_string(t);
-      first = false;
+void ElasticSearchInterface::pb2json(const DecodedReport &report, const char *trace_id, std::string *out) {
+  const freudpb::Report &pb = report.get_report();
+  const bool detailed = pb.type() == freudpb::Report::DETAILED;
+  JsonWriter json(out);
+
+  json.begin_object();
+  json.key("pid");
+  json.value_int(pb.pid());
+  json.key("hostname");
+  json.value_string(report.get_hostname());
+  json.key("procname");
+  json.value_string(pb.procname());
+  json.key("basename");
+  json.value_string(basename(pb.procname().c_str()));
+  json.key("pgname");
+  json.value_string(pb.pgname());
+  json.key("type");
+  json.value_string(detailed ? "detailed" : "summary");
+  // normalize usec to msec (that's what ES expects)
+  json.key("time");
+  json.value_uint(pb.usec_ts() / 1000);
+  json.key("module");
+  json.value_string(pb.module_name());
+
+  if (detailed) {
+    json.key("instance");
+    json.value_uint(pb.instance_id());
+
+    // if not a summary, append array of traces, or a reference to it
+    if (trace_id) {
+      json.key("trace_id");
+      json.value_string(trace_id);
+    } else {
+      json.key("trace");
+      json.begin_array();
+      for (const uint64_t &t : pb.trace())
+        json.value_uint(t);
+      json.end_array();
     }
-    result += "], ";
-  }
 
-  // if not a summary, append generic info here; if this a summary,
-  // these info will go inside the module section instead
-  if (pb.type() == freudpb::Report::DETAILED) {
-    result += "\"generic_info\": {";
-    append_kv_list(&result, pb.generic_info());
-    result += "}, ";
+    // if not a summary, append generic info here; if this a summary,
+    // these info will go inside the module section instead
+    json.key("generic_info");
+    json.begin_object();
+    write_kv_list(&json, pb.generic_info());
+    json.end_object();
   }
 
   // append module info
-  result += "\"" + pb.module_name() +"\": {";
-  append_kv_list(&result, pb.module_info());
+  json.key(pb.module_name());
+  json.begin_object();
+  write_kv_list(&json, pb.module_info());
   // if this a summary, append some metafields
-  if (pb.type() == freudpb::Report::SUMMARY) {
-    // need this separator only if actual module info were outputted already
-    if (pb.module_info_size())
-      result += ", ";
-
+  if (!detailed) {
     // number of instances
-    append_kv_uint64(&result, "__instances", pb.instance_id());
+    json.key("__instances");
+    json.value_uint(pb.instance_id());
 
     // all data from the generic_info, if any, prefixed with two underscores
-    if (pb.generic_info_size()) {
-      result += ", ";
-      append_kv_list(&result, pb.generic_info(), "__");
-    }
+    write_kv_list(&json, pb.generic_info(), "__");
   }
-  result += "} ";
+  json.end_object();
 
   // append instance info, if meaningful and present
-  if (pb.type() == freudpb::Report::DETAILED && pb.has_instance_info()) {
-    result += ", ";
-    append_kv_string(&result, "instance_info", pb.instance_info());
+  if (detailed && pb.has_instance_info()) {
+    json.key("instance_info");
+    json.value_string(pb.instance_info());
   }
 
-  result += " }";
-
-  return result;
-}
-
-void ElasticSearchInterface::append_kv_int32(std::string *s, const std::string &k, const int32_t v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_uint32(std::string *s, const std::string &k, const uint32_t v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_int64(std::string *s, const std::string &k, const int64_t v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_uint64(std::string *s, const std::string &k, const uint64_t v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_float(std::string *s, const std::string &k, const float &v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_double(std::string *s, const std::string &k, const double &v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": ");
-  s->append(std::to_string(v));
-  s->append(" ");
-}
-
-void ElasticSearchInterface::append_kv_string(std::string *s, const std::string &k, const std::string &v) {
-  s->append("\"");
-  s->append(k);
-  s->append("\": \"");
-  s->append(v);
-  s->append("\" ");
+  json.end_object();
 }
 
-void ElasticSearchInterface::append_kv_list(std::string *s,
-                                            const ::google::protobuf::RepeatedPtrField<freudpb::KeyValue> &list,
-                                            const std::string &prefix) {
-  bool first = true;
+void ElasticSearchInterface::write_kv_list(JsonWriter *json,
+                                           const ::google::protobuf::RepeatedPtrField<freudpb::KeyValue> &list,
+                                           const char *prefix) {
   for (const freudpb::KeyValue &kv: list) {
     switch (kv.type()) {
       case freudpb::KeyValue::INVALID:
@@ -413,10 +375,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::UINT32:
         if (kv.has_value_u32()) {
-          if (!first)
-            s->append(", ");
-          append_kv_uint32(s, prefix + kv.key(), kv.value_u32());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_uint(kv.value_u32());
         } else {
           fprintf(stderr, "WARNING: %s uint32 not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -424,10 +384,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::SINT32:
         if (kv.has_value_s32()) {
-          if (!first)
-            s->append(", ");
-          append_kv_int32(s, prefix + kv.key(), kv.value_s32());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_int(kv.value_s32());
         } else {
           fprintf(stderr, "WARNING: %s int32 not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -435,10 +393,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::UINT64:
         if (kv.has_value_u64()) {
-          if (!first)
-            s->append(", ");
-          append_kv_uint64(s, prefix + kv.key(), kv.value_u64());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_uint(kv.value_u64());
         } else {
           fprintf(stderr, "WARNING: %s uint64 not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -446,10 +402,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::SINT64:
         if (kv.has_value_s64()) {
-          if (!first)
-            s->append(", ");
-          append_kv_int64(s, prefix + kv.key(), kv.value_s64());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_int(kv.value_s64());
         } else {
           fprintf(stderr, "WARNING: %s int64 not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -457,10 +411,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::FLOAT:
         if (kv.has_value_float()) {
-          if (!first)
-            s->append(", ");
-          append_kv_float(s, prefix + kv.key(), kv.value_float());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_float(kv.value_float());
         } else {
           fprintf(stderr, "WARNING: %s float not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -468,10 +420,8 @@ void ElasticSearchInterface::append_kv_list(std::string *s,
 
       case freudpb::KeyValue::DOUBLE:
         if (kv.has_value_dbl()) {
-          if (!first)
-            s->append(", ");
-          append_kv_double(s, prefix + kv.key(), kv.value_dbl());
-          first = false;
+          json->key(kv.key(), prefix);
+          json->value_double(kv.value_dbl());
         } else {
           fprintf(stderr, "WARNING: %s double not found for key %s\n", __FUNCTION__, kv.key().c_str());
         }
@@ -19,102 +19,143 @@
 #pragma once
 
 #include <stdint.h>
+#include <time.h>
+#include <atomic>
 #include <string>
+#include <vector>
 #include <curl/curl.h>
 #include "lib/configurator.h"
+#include "lib/es_bulk.h"
+#include "lib/es_lifecycle.h"
 #include "lib/freud-data.pb.h"
+#include "lib/json_writer.h"
+#include "lib/msg_pool.h"
+#include "lib/report_decoder.h"
+#include "lib/sink.h"
+#include "lib/trace_dictionary.h"
+
+// number of daily indices whose routes are cached, per index family
+#define ES_ROUTE_CACHE_SIZE 4
 
 namespace freud {
 namespace lib {
 
 class ElasticSearchIndexManager {
  public:
-  explicit ElasticSearchIndexManager(const std::string &base_address);
+  ElasticSearchIndexManager(const std::vector<std::string> &base_addresses, const Configurator &config);
   ~ElasticSearchIndexManager() = default;
 
-  bool init_index(const std::string &index_name, const std::string &mappings);
+  bool init_index(const std::string &index_name, const ElasticSearchIndexLifecycle::Mappings &mappings);
+  // same, for an index that does not roll over daily
+  void init_static_index(const std::string &index_name, const ElasticSearchIndexLifecycle::Mappings &mappings);
+  // start creating daily indices in the background, once all of them
+  // have been set up with init_index()
+  void start();
+  // event_ts selects the daily index, in seconds since Epoch (UTC);
+  // replay_id is that of the message the document was built from
   bool send(const std::string &index_name, const std::string &document_name,
-            const std::string &postdata, const tm &event_ts);
+            const std::string &postdata, const time_t event_ts, const int64_t replay_id = 0);
+  // send to a static index, under the given document id
+  void send_static(const std::string &index_name, const std::string &document_name, const char *document_id,
+                   const std::string &postdata);
 
- private:
-  class DocInfo {
-   public:
-    DocInfo(const std::string &name, const std::string &full_url);
-    ~DocInfo();
+  ElasticSearchBulkWriter& get_bulk_writer() { return bulk_writer_; }
+  const ElasticSearchBulkWriter& get_bulk_writer() const { return bulk_writer_; }
 
-    bool send(const std::string &postdata);
-
-   private:
-    const std::string document_name_;
-    const std::string document_post_url_;
-    CURL *handle_;
-    char errbuf_[CURL_ERROR_SIZE];
-  };
+  void dump_stats(FILE *fp) const;
 
+ private:
   class IndexInfo {
    public:
-    IndexInfo(const std::string &name, const std::string &base_post_url, const std::string &mappings);
+    IndexInfo(const std::string &name, ElasticSearchIndexLifecycle *lifecycle,
+              ElasticSearchBulkWriter *bulk_writer);
     ~IndexInfo() = default;
 
-    bool send(const std::string &document_name, const std::string &postdata, const tm &event_ts);
+    bool send(const std::string &document_name, const std::string &postdata, const time_t event_ts,
+              const int64_t replay_id);
 
    private:
+    // a daily index, and the [begin, end) range of timestamps it holds
+    struct Route {
+      time_t begin;
+      time_t end;
+      std::string daily_index_name;
+    };
+
     const std::string index_name_;
-    const std::string base_post_url_; // this URL does not include the current index name
-    const std::string mappings_;
-
-    std::string current_post_url_; // this URL also includes the current index name
-    std::map<std::string, DocInfo*> documents_;
-
-    // ts data about the event stored with the most recent timestamp
-    struct {
-      int year_;
-      int month_;
-      int day_;
-    } ts_last_update_;
-
-    void setup_mappings();
-    // update the timestamp of the most recent timestamp; returns true
-    // if there was an actual forward update
-    bool update_cached_ts(const tm &event_ts);
+    ElasticSearchIndexLifecycle *const lifecycle_;
+    ElasticSearchBulkWriter *const bulk_writer_;
+
+    // most events fall within the same day or two, so a few routes are
+    // enough to avoid formatting index names for every event
+    Route routes_[ES_ROUTE_CACHE_SIZE];
+    size_t next_route_; // cache slot to replace on the next miss
+
+    // returns NULL if no index name can be derived from event_ts
+    const Route* get_route(const time_t event_ts);
   };
 
-  const std::string base_address_;
+  ElasticSearchIndexLifecycle lifecycle_;
+  ElasticSearchBulkWriter bulk_writer_;
   std::map<std::string, IndexInfo> indices_;
 };
 
-class ElasticSearchInterface {
+class ElasticSearchInterface : public Sink {
  public:
   explicit ElasticSearchInterface(const Configurator &config);
-  ~ElasticSearchInterface() = default;
+  ~ElasticSearchInterface() override;
 
   bool init();
 
-  bool post_packet(const std::string &pkt);
-
-  static size_t curl_null_cb(void *buffer, size_t size, size_t nmemb, void *userp);
+  // now is used to check the timestamp of the report against the
+  // acceptance windows
+  bool post_packet(const MsgBuffer &msg, const time_t now);
+  // returns the number of packets posted successfully
+  size_t post_packets(MsgBuffer *const *msgs, const size_t count);
+
+  // Sink interface
+  const char* get_sink_name() const override { return "ES"; }
+  size_t consume_batch(MsgBuffer *const *msgs, const size_t count) override {
+    return post_packets(msgs, count);
+  }
+  int64_t tick(const bool idle) override { return index_manager_.get_bulk_writer().poll(idle); }
+  void flush() override { index_manager_.get_bulk_writer().flush_all(); }
+  int64_t get_unsettled_replay_id() const override {
+    return index_manager_.get_bulk_writer().get_unsettled_replay_id();
+  }
+  void dump_stats(FILE *fp) const override;
 
  private:
-  const std::string base_address_;
   const std::string index_name_;
-  freudpb::Report pkt_post_pb_;
 
-  std::string hostname_;
   ElasticSearchIndexManager index_manager_;
   const bool send_detailed_reports_;
+  // 0 means no limit
+  const time_t accept_past_sec_;
+  const time_t accept_future_sec_;
+
+  std::atomic<uint64_t> rejected_past_;
+  std::atomic<uint64_t> rejected_future_;
+
+  // with interning, traces are written once to their own index, and
+  // detailed reports only refer to them by id; NULL if disabled
+  TraceDictionary *traces_;
+  const std::string trace_index_name_;
+  std::string tracedata_;
+
+  // serialized document, reused across reports
+  std::string postdata_;
 
   void setup_es_documents();
 
-  std::string pb2json(const freudpb::Report &pb);
-  void append_kv_int32(std::string *s, const std::string &k, const int32_t v);
-  void append_kv_uint32(std::string *s, const std::string &k, const uint32_t v);
-  void append_kv_int64(std::string *s, const std::string &k, const int64_t v);
-  void append_kv_uint64(std::string *s, const std::string &k, const uint64_t v);
-  void append_kv_float(std::string *s, const std::string &k, const float &v);
-  void append_kv_double(std::string *s, const std::string &k, const double &v);
-  void append_kv_string(std::string *s, const std::string &k, const std::string &v);
-  void append_kv_list(std::string *s, const ::google::protobuf::RepeatedPtrField<freudpb::KeyValue> &list,
-                      const std::string &prefix = "");
+  // append the JSON document for report to out; detailed reports
+  // refer to their trace by trace_id, if not NULL
+  void pb2json(const DecodedReport &report, const char *trace_id, std::string *out);
+  // queue the document for the trace of pb, unless it was sent
+  // recently; trace_id gets its hex id
+  void intern_trace(const freudpb::Report &pb, char *trace_id, const size_t trace_id_len);
+  void write_kv_list(JsonWriter *json, const ::google::protobuf::RepeatedPtrField<freudpb::KeyValue> &list,
+                     const char *prefix = NULL);
 };
 
 } // namespace lib
@@ -0,0 +1,314 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/es_lifecycle.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+
+// how often to look ahead for upcoming days
+#define LIFECYCLE_PASS_SEC 60
+// how long to wait before retrying failed creations; documents for
+// those indices are held in the meantime
+#define LIFECYCLE_RETRY_SEC 5
+// how much of an ES error to show in warnings
+#define LIFECYCLE_MAX_ERROR_CHARS 512
+// keep a slow node from holding up shutdown for long
+#define LIFECYCLE_TIMEOUT_SEC 30
+
+namespace freud {
+namespace lib {
+
+ElasticSearchIndexLifecycle::ElasticSearchIndexLifecycle(const std::vector<std::string> &base_addresses)
+    : base_addresses_(base_addresses), stopping_(false), worker_(NULL), handle_(NULL),
+      created_(0), updated_(0), conflicts_(0), failures_(0), pending_count_(0) {
+}
+
+ElasticSearchIndexLifecycle::~ElasticSearchIndexLifecycle() {
+  stop();
+}
+
+void ElasticSearchIndexLifecycle::add_index(const std::string &index_name, const Mappings &mappings) {
+  add_family(index_name, mappings, true);
+}
+
+void ElasticSearchIndexLifecycle::add_static_index(const std::string &index_name, const Mappings &mappings) {
+  add_family(index_name, mappings, false);
+}
+
+void ElasticSearchIndexLifecycle::add_family(const std::string &index_name, const Mappings &mappings,
+                                             const bool daily) {
+  std::string create_body = "{\"mappings\":{";
+  for (const auto &type : mappings) {
+    if (create_body.back() != '{')
+      create_body += ',';
+    create_body += '"';
+    create_body += type.first;
+    create_body += "\":";
+    create_body += type.second;
+  }
+  create_body += "}}";
+
+  families_.push_back(Family{index_name, mappings, create_body, daily});
+}
+
+void ElasticSearchIndexLifecycle::start() {
+  if (worker_)
+    return;
+
+  stopping_ = false;
+  worker_ = new std::thread(&ElasticSearchIndexLifecycle::worker_fn, this);
+}
+
+void ElasticSearchIndexLifecycle::stop() {
+  if (!worker_)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+
+  worker_->join();
+  delete worker_;
+  worker_ = NULL;
+}
+
+void ElasticSearchIndexLifecycle::ensure(const std::string &index_name, const std::string &daily_index_name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!known_.insert(daily_index_name).second)
+      // created already, or on its way
+      return;
+
+    pending_.push_back(PendingIndex{index_name, daily_index_name});
+    pending_count_.store(pending_.size(), std::memory_order_relaxed);
+  }
+  wakeup_.notify_one();
+}
+
+void ElasticSearchIndexLifecycle::ensure(const std::string &daily_index_name) {
+  // <index_name>-YYYY.MM.DD, or a static index name
+  const size_t suffix_len = strlen("-YYYY.MM.DD");
+  for (const Family &family : families_) {
+    const std::string &name = family.index_name;
+    if (family.daily ? daily_index_name.size() == name.size() + suffix_len &&
+                       daily_index_name.compare(0, name.size(), name) == 0 && daily_index_name[name.size()] == '-'
+                     : daily_index_name == name) {
+      ensure(name, daily_index_name);
+      return;
+    }
+  }
+}
+
+bool ElasticSearchIndexLifecycle::is_ready(const std::string &daily_index_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ready_.count(daily_index_name) != 0;
+}
+
+void ElasticSearchIndexLifecycle::dump_stats(FILE *fp) const {
+  fprintf(fp, "STATS: ES index lifecycle: %" PRIu64 " indices created, %" PRIu64 " existing indices updated, %"
+          PRIu64 " mapping conflicts, %" PRIu64 " mapping failures, %zu pending\n",
+          created_.load(), updated_.load(), conflicts_.load(), failures_.load(), pending_count_.load());
+}
+
+std::string ElasticSearchIndexLifecycle::get_daily_name(const std::string &index_name, const struct tm &ts) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "-%.4d.%.2d.%.2d", ts.tm_year + 1900, ts.tm_mon + 1, ts.tm_mday);
+  return index_name + suffix;
+}
+
+void ElasticSearchIndexLifecycle::worker_fn() {
+  handle_ = curl_easy_init();
+  curl_easy_setopt(handle_, CURLOPT_POST, 1);
+  curl_easy_setopt(handle_, CURLOPT_ERRORBUFFER, errbuf_);
+  curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION, ElasticSearchIndexLifecycle::curl_append_cb);
+  curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &response_);
+  curl_easy_setopt(handle_, CURLOPT_TIMEOUT, (long) LIFECYCLE_TIMEOUT_SEC);
+  curl_easy_setopt(handle_, CURLOPT_NOSIGNAL, 1L);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::chrono::steady_clock::time_point next_pass = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point next_retry = next_pass;
+  // failures stay known, so that they are not queued twice, and are
+  // queued again once their retry is due
+  std::vector<PendingIndex> failed;
+  while (!stopping_) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now >= next_retry) {
+      pending_.insert(pending_.end(), failed.begin(), failed.end());
+      failed.clear();
+    }
+    if (now >= next_pass) {
+      lock.unlock();
+      schedule_upcoming();
+      lock.lock();
+      next_pass = std::chrono::steady_clock::now() + std::chrono::seconds(LIFECYCLE_PASS_SEC);
+    }
+
+    while (!pending_.empty() && !stopping_) {
+      const PendingIndex index = pending_.front();
+      lock.unlock();
+      const bool ok = create(index.index_name, index.daily_index_name);
+      lock.lock();
+
+      pending_.pop_front();
+      if (ok) {
+        ready_.insert(index.daily_index_name);
+      } else {
+        if (failed.empty())
+          next_retry = std::chrono::steady_clock::now() + std::chrono::seconds(LIFECYCLE_RETRY_SEC);
+        failed.push_back(index);
+      }
+      pending_count_.store(pending_.size() + failed.size(), std::memory_order_relaxed);
+    }
+
+    wakeup_.wait_until(lock, failed.empty() || next_pass < next_retry ? next_pass : next_retry,
+                       [this]() { return stopping_ || !pending_.empty(); });
+  }
+  lock.unlock();
+
+  curl_easy_cleanup(handle_);
+  handle_ = NULL;
+}
+
+void ElasticSearchIndexLifecycle::schedule_upcoming() {
+  for (const Family &family : families_)
+    if (!family.daily)
+      ensure(family.index_name, family.index_name);
+
+  const time_t now = time(NULL);
+  for (const time_t ts : {now, now + 24 * 3600}) {
+    struct tm broken_down_time;
+    if (!gmtime_r(&ts, &broken_down_time))
+      continue;
+
+    for (const Family &family : families_)
+      if (family.daily)
+        ensure(family.index_name, get_daily_name(family.index_name, broken_down_time));
+  }
+}
+
+bool ElasticSearchIndexLifecycle::create(const std::string &index_name, const std::string &daily_index_name) {
+  const Family *family = find_family(index_name);
+  if (!family)
+    return false;
+
+  for (const std::string &base_address : base_addresses_) {
+    const std::string url = base_address + daily_index_name + "/";
+    errbuf_[0] = '\0';
+    response_.clear();
+    curl_easy_setopt(handle_, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(handle_, CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(handle_, CURLOPT_POSTFIELDS, family->create_body.c_str());
+    curl_easy_setopt(handle_, CURLOPT_POSTFIELDSIZE, (long) family->create_body.size());
+
+    const CURLcode res = curl_easy_perform(handle_);
+    long status = 0;
+    curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE, &status);
+    if (res == CURLE_OK && status < 300) {
+      created_.fetch_add(1, std::memory_order_relaxed);
+      fprintf(stderr, "INFO: index [%s] is ready\n", daily_index_name.c_str());
+      return true;
+    }
+    if (res == CURLE_OK && response_.find("already_exists") != std::string::npos)
+      // e.g. from a previous run, but it might have been created by ES
+      // itself, with dynamic mappings: make sure ours are in place
+      return update_mappings(base_address, daily_index_name, *family);
+
+    if (res != CURLE_OK)
+      fprintf(stderr, "WARNING: ES mapping init failed for index %s at URL[%s]: %d(%s), %s\n",
+              daily_index_name.c_str(), url.c_str(),
+              res, curl_easy_strerror(res),
+              // errbuf might not have been populated
+              errbuf_[0] ? errbuf_ : "");
+    else
+      fprintf(stderr, "WARNING: ES mapping init failed for index %s at URL[%s] with HTTP status %ld\n",
+              daily_index_name.c_str(), url.c_str(), status);
+
+    if (res == CURLE_OK)
+      // the node answered, the others would not do any better
+      break;
+  }
+
+  failures_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+bool ElasticSearchIndexLifecycle::update_mappings(const std::string &base_address,
+                                                  const std::string &daily_index_name, const Family &family) {
+  size_t conflicts = 0;
+  for (const auto &type : family.mappings) {
+    const std::string url = base_address + daily_index_name + "/_mapping/" + type.first;
+    errbuf_[0] = '\0';
+    response_.clear();
+    curl_easy_setopt(handle_, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(handle_, CURLOPT_CUSTOMREQUEST, "PUT");
+    curl_easy_setopt(handle_, CURLOPT_POSTFIELDS, type.second.c_str());
+    curl_easy_setopt(handle_, CURLOPT_POSTFIELDSIZE, (long) type.second.size());
+
+    const CURLcode res = curl_easy_perform(handle_);
+    long status = 0;
+    curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE, &status);
+    if (res == CURLE_OK && status < 300)
+      continue;
+
+    if (res != CURLE_OK || status >= 500) {
+      fprintf(stderr, "WARNING: ES mapping update failed for index %s at URL[%s]: %s\n",
+              daily_index_name.c_str(), url.c_str(),
+              res != CURLE_OK ? curl_easy_strerror(res) : "server error");
+      failures_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    // the index holds documents that do not fit our mappings: trying
+    // again would not help, nor would holding documents back
+    ++conflicts;
+    fprintf(stderr, "ERROR: index [%s] exists with a mapping for type [%s] that conflicts with ours, HTTP status "
+            "%ld: %.*s\n",
+            daily_index_name.c_str(), type.first.c_str(), status, LIFECYCLE_MAX_ERROR_CHARS, response_.c_str());
+  }
+
+  if (conflicts) {
+    conflicts_.fetch_add(conflicts, std::memory_order_relaxed);
+  } else {
+    updated_.fetch_add(1, std::memory_order_relaxed);
+    fprintf(stderr, "INFO: index [%s] existed already, and is ready\n", daily_index_name.c_str());
+  }
+  return true;
+}
+
+const ElasticSearchIndexLifecycle::Family* ElasticSearchIndexLifecycle::find_family(
+    const std::string &index_name) const {
+  for (const Family &family : families_)
+    if (family.index_name == index_name)
+      return &family;
+  return NULL;
+}
+
+size_t ElasticSearchIndexLifecycle::curl_append_cb(void *buffer, size_t size, size_t nmemb, void *userp) {
+  std::string *response = static_cast<std::string*>(userp);
+  response->append(static_cast<const char*>(buffer), size * nmemb);
+  return size * nmemb;
+}
+
+} // namespace lib
+} // namespace freud
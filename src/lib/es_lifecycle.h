@@ -0,0 +1,137 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <curl/curl.h>
+
+namespace freud {
+namespace lib {
+
+// Creates the daily indices, with their mappings, from a background
+// thread, so that rolling over to a new day never stalls ingest. Every
+// pass ensures that today's and tomorrow's indices exist, i.e. each
+// index is normally created a day before it is needed; indices for
+// other days are created on demand. Static indices, that do not roll
+// over, are created once. An index that exists already (e.g. from a
+// previous run) gets our mappings put on it, type by type; conflicts
+// are counted and reported, as retrying would not help. Other failures
+// are counted, and retried shortly.
+//
+// Documents must not be sent to an index before is_ready() says so, or
+// ES would create it on its own, with dynamic mappings.
+class ElasticSearchIndexLifecycle {
+ public:
+  // type name -> mapping of that type, i.e. {"properties":{...}}
+  typedef std::map<std::string, std::string> Mappings;
+
+  explicit ElasticSearchIndexLifecycle(const std::vector<std::string> &base_addresses);
+  ~ElasticSearchIndexLifecycle();
+
+  // register an index family, before start(); daily indices are named
+  // <index_name>-YYYY.MM.DD
+  void add_index(const std::string &index_name, const Mappings &mappings);
+  // register an index that does not roll over, before start()
+  void add_static_index(const std::string &index_name, const Mappings &mappings);
+
+  void start();
+  void stop();
+
+  // never waits on the network: the index is queued for creation,
+  // unless it is known to exist already
+  void ensure(const std::string &index_name, const std::string &daily_index_name);
+  // same, finding the family from the name of the daily index; a
+  // no-op if no family matches
+  void ensure(const std::string &daily_index_name);
+  // true once the index exists with our mappings; thread-safe
+  bool is_ready(const std::string &daily_index_name);
+
+  void dump_stats(FILE *fp) const;
+
+  // <index_name>-YYYY.MM.DD, for the day of ts (UTC)
+  static std::string get_daily_name(const std::string &index_name, const struct tm &ts);
+
+ private:
+  struct Family {
+    std::string index_name;
+    Mappings mappings;
+    // {"mappings":{...}}, to create an index in one go
+    std::string create_body;
+    bool daily;
+  };
+
+  struct PendingIndex {
+    std::string index_name;
+    std::string daily_index_name;
+  };
+
+  const std::vector<std::string> base_addresses_;
+  // read-only once started
+  std::vector<Family> families_;
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  bool stopping_;
+  std::deque<PendingIndex> pending_;
+  // daily indices known to exist, or queued for creation
+  std::set<std::string> known_;
+  // daily indices known to exist, with our mappings
+  std::set<std::string> ready_;
+  std::thread *worker_;
+
+  // owned by the worker, reused so that its connections stay warm
+  CURL *handle_;
+  char errbuf_[CURL_ERROR_SIZE];
+  std::string response_;
+
+  std::atomic<uint64_t> created_;
+  std::atomic<uint64_t> updated_;
+  std::atomic<uint64_t> conflicts_;
+  std::atomic<uint64_t> failures_;
+  std::atomic<size_t> pending_count_;
+
+  void add_family(const std::string &index_name, const Mappings &mappings, const bool daily);
+  void worker_fn();
+  // queue static indices, and today's and tomorrow's daily ones, if
+  // needed
+  void schedule_upcoming();
+  // returns false if no node accepted the mappings
+  bool create(const std::string &index_name, const std::string &daily_index_name);
+  // put the mappings of family on an existing index, through the node
+  // at base_address; returns false if it should be tried again
+  bool update_mappings(const std::string &base_address, const std::string &daily_index_name,
+                       const Family &family);
+  const Family* find_family(const std::string &index_name) const;
+
+  static size_t curl_append_cb(void *buffer, size_t size, size_t nmemb, void *userp);
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,128 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/es_nodes.h"
+
+#include <inttypes.h>
+
+namespace freud {
+namespace lib {
+
+ElasticSearchNodes::ElasticSearchNodes(const std::vector<std::string> &base_addresses, const Balance balance,
+                                       const uint32_t max_failures, const uint32_t eject_msec)
+    : balance_(balance), max_failures_(max_failures ? max_failures : 1), eject_usec_(eject_msec * 1000L),
+      next_(0) {
+  for (const std::string &address : base_addresses)
+    nodes_.push_back(new Node(address));
+}
+
+ElasticSearchNodes::~ElasticSearchNodes() {
+  for (Node *node : nodes_)
+    delete node;
+  nodes_.clear();
+}
+
+size_t ElasticSearchNodes::acquire(const int64_t now) {
+  readmit(now);
+
+  // scan from the round-robin cursor, so that ties are spread evenly
+  size_t best = nodes_.size();
+  size_t fallback = 0;
+  for (size_t n = 0; n < nodes_.size(); ++n) {
+    const size_t i = (next_ + n) % nodes_.size();
+    const Node *node = nodes_[i];
+    if (node->ejected.load(std::memory_order_relaxed)) {
+      if (node->ts_ejected_until < nodes_[fallback]->ts_ejected_until)
+        fallback = i;
+      continue;
+    }
+
+    if (best == nodes_.size()) {
+      best = i;
+      if (balance_ == BALANCE_ROUND_ROBIN)
+        break;
+    } else if (node->inflight.load(std::memory_order_relaxed) <
+               nodes_[best]->inflight.load(std::memory_order_relaxed)) {
+      best = i;
+    }
+  }
+
+  if (best == nodes_.size())
+    // the whole cluster looks down: probe the node due back first
+    best = fallback;
+  next_ = (best + 1) % nodes_.size();
+
+  Node *node = nodes_[best];
+  node->inflight.fetch_add(1, std::memory_order_relaxed);
+  node->requests.fetch_add(1, std::memory_order_relaxed);
+  return best;
+}
+
+void ElasticSearchNodes::release(const size_t index, const bool healthy, const int64_t now) {
+  Node *node = nodes_[index];
+  node->inflight.fetch_sub(1, std::memory_order_relaxed);
+
+  if (healthy) {
+    node->consecutive_failures = 0;
+    node->probation = false;
+    if (node->ejected.load(std::memory_order_relaxed)) {
+      // a probe got through, no need to wait for the ejection to expire
+      if (nodes_.size() > 1)
+        fprintf(stderr, "INFO: ES node [%s] back in rotation\n", node->base_address.c_str());
+      node->ejected.store(false, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  node->failures.fetch_add(1, std::memory_order_relaxed);
+  ++node->consecutive_failures;
+  if (node->ejected.load(std::memory_order_relaxed) ||
+      (!node->probation && node->consecutive_failures < max_failures_))
+    return;
+
+  if (nodes_.size() > 1)
+    fprintf(stderr, "WARNING: ES node [%s] ejected for %" PRId64 " msec after %u consecutive failure(s)\n",
+            node->base_address.c_str(), eject_usec_ / 1000, node->consecutive_failures);
+  node->consecutive_failures = 0;
+  node->probation = true;
+  node->ts_ejected_until = now + eject_usec_;
+  node->ejections.fetch_add(1, std::memory_order_relaxed);
+  node->ejected.store(true, std::memory_order_relaxed);
+}
+
+void ElasticSearchNodes::dump_stats(FILE *fp) const {
+  for (const Node *node : nodes_)
+    fprintf(fp, "STATS: ES node [%s]: %u requests in flight, %" PRIu64 " requests, %" PRIu64 " failures, %" PRIu64
+            " ejections, %s\n",
+            node->base_address.c_str(), node->inflight.load(), node->requests.load(), node->failures.load(),
+            node->ejections.load(), node->ejected.load() ? "ejected" : "in rotation");
+}
+
+void ElasticSearchNodes::readmit(const int64_t now) {
+  for (Node *node : nodes_) {
+    if (!node->ejected.load(std::memory_order_relaxed) || now < node->ts_ejected_until)
+      continue;
+
+    if (nodes_.size() > 1)
+      fprintf(stderr, "INFO: ES node [%s] back in rotation, on probation\n", node->base_address.c_str());
+    node->ejected.store(false, std::memory_order_relaxed);
+  }
+}
+
+} // namespace lib
+} // namespace freud
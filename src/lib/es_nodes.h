@@ -0,0 +1,92 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace freud {
+namespace lib {
+
+// The ES nodes requests are spread over. A node that fails too many
+// requests in a row is ejected, i.e. skipped, for a while; once back,
+// it is on probation, and a single failure ejects it again. If all
+// nodes are ejected, the one due back first is used anyway, so that
+// requests keep probing the cluster. Not thread-safe, except for
+// dump_stats().
+class ElasticSearchNodes {
+ public:
+  enum Balance {
+    BALANCE_ROUND_ROBIN,
+    // the node with the fewest requests in flight
+    BALANCE_LEAST_OUTSTANDING,
+  };
+
+  ElasticSearchNodes(const std::vector<std::string> &base_addresses, const Balance balance,
+                     const uint32_t max_failures, const uint32_t eject_msec);
+  ~ElasticSearchNodes();
+
+  size_t get_count() const { return nodes_.size(); }
+  const std::string& get_address(const size_t node) const { return nodes_[node]->base_address; }
+
+  // pick the node for the next request, and account for it as in
+  // flight until release()
+  size_t acquire(const int64_t now);
+  // healthy is false if the node could not serve the request at all
+  // (connection errors, 5xx statuses)
+  void release(const size_t node, const bool healthy, const int64_t now);
+
+  void dump_stats(FILE *fp) const;
+
+ private:
+  struct Node {
+    explicit Node(const std::string &address)
+        : base_address(address), consecutive_failures(0), probation(false), ts_ejected_until(0),
+          inflight(0), requests(0), failures(0), ejections(0), ejected(false) {}
+
+    const std::string base_address;
+    uint32_t consecutive_failures;
+    bool probation;
+    int64_t ts_ejected_until; // monotonic usec
+
+    // stats
+    std::atomic<uint32_t> inflight;
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> failures;
+    std::atomic<uint64_t> ejections;
+    std::atomic<bool> ejected;
+  };
+
+  const Balance balance_;
+  const uint32_t max_failures_;
+  const int64_t eject_usec_;
+
+  std::vector<Node*> nodes_;
+  size_t next_; // round-robin cursor
+
+  // put nodes whose ejection expired back in rotation
+  void readmit(const int64_t now);
+};
+
+} // namespace lib
+} // namespace freud
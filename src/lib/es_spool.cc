@@ -0,0 +1,343 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/es_spool.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// every payload on disk is a header, the index name, then the body
+#define SPOOL_RECORD_MAGIC 0x53504f4cU // "SPOL"
+
+namespace freud {
+namespace lib {
+
+namespace {
+
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t checksum; // of everything after the header
+  uint32_t index_len;
+  uint32_t item_count;
+  uint64_t body_len;
+};
+
+// FNV-1a; only meant to catch torn writes
+uint32_t checksum(uint32_t hash, const char *data, const size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (uint8_t) data[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+const uint32_t kChecksumSeed = 2166136261U;
+
+bool write_fully(const int fd, const char *data, size_t len) {
+  while (len) {
+    const ssize_t res = write(fd, data, len);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += res;
+    len -= res;
+  }
+  return true;
+}
+
+bool pread_fully(const int fd, char *data, size_t len, off_t offset) {
+  while (len) {
+    const ssize_t res = pread(fd, data, len, offset);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (!res)
+      // truncated
+      return false;
+    data += res;
+    len -= res;
+    offset += res;
+  }
+  return true;
+}
+
+} // namespace
+
+ElasticSearchSpool::ElasticSearchSpool(const std::string &directory, const uint64_t max_bytes,
+                                       const uint64_t segment_bytes)
+    : directory_(directory), max_bytes_(max_bytes), segment_bytes_(segment_bytes),
+      total_bytes_(0), write_fd_(-1), read_seq_(0), read_offset_(0), ahead_seq_(0), ahead_offset_(0), read_fd_(-1),
+      read_fd_seq_(0) {
+}
+
+ElasticSearchSpool::~ElasticSearchSpool() {
+  if (write_fd_ >= 0)
+    close(write_fd_);
+  if (read_fd_ >= 0)
+    close(read_fd_);
+}
+
+bool ElasticSearchSpool::init() {
+  if (mkdir(directory_.c_str(), 0700) < 0 && errno != EEXIST) {
+    fprintf(stderr, "ERROR: mkdir %s: %s\n", directory_.c_str(), strerror(errno));
+    return false;
+  }
+
+  DIR *dir = opendir(directory_.c_str());
+  if (!dir) {
+    fprintf(stderr, "ERROR: opendir %s: %s\n", directory_.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    uint64_t seq;
+    char tail;
+    if (sscanf(entry->d_name, "segment-%" SCNu64 "%c", &seq, &tail) != 1)
+      continue;
+
+    struct stat st;
+    if (stat(segment_path(seq).c_str(), &st) < 0)
+      continue;
+    segments_[seq] = st.st_size;
+    total_bytes_ += st.st_size;
+  }
+  closedir(dir);
+
+  load_cursor();
+  if (!segments_.empty()) {
+    if (segments_.find(read_seq_) == segments_.end()) {
+      // no usable cursor, replay everything left
+      read_seq_ = segments_.begin()->first;
+      read_offset_ = 0;
+    }
+    fprintf(stderr, "INFO: ES spool at %s holds %zu segment(s), %" PRIu64 " bytes\n",
+            directory_.c_str(), segments_.size(), total_bytes_);
+  }
+  ahead_seq_ = read_seq_;
+  ahead_offset_ = read_offset_;
+
+  // never append to a segment that a crash might have left torn
+  return open_new_segment();
+}
+
+bool ElasticSearchSpool::is_empty() const {
+  if (segments_.empty())
+    return true;
+  return read_seq_ == segments_.rbegin()->first && read_offset_ >= segments_.rbegin()->second;
+}
+
+bool ElasticSearchSpool::has_unread() const {
+  if (segments_.empty())
+    return false;
+  return ahead_seq_ != segments_.rbegin()->first || ahead_offset_ < segments_.rbegin()->second;
+}
+
+bool ElasticSearchSpool::append(const std::string &index_name, const std::string &body, const uint32_t item_count) {
+  const uint64_t record_bytes = sizeof(RecordHeader) + index_name.size() + body.size();
+  if (total_bytes_ + record_bytes > max_bytes_)
+    return false;
+
+  if (write_fd_ < 0 || segments_.rbegin()->second >= segment_bytes_)
+    if (!open_new_segment())
+      return false;
+
+  RecordHeader header;
+  header.magic = SPOOL_RECORD_MAGIC;
+  header.index_len = index_name.size();
+  header.item_count = item_count;
+  header.body_len = body.size();
+  header.checksum = checksum(checksum(kChecksumSeed, index_name.data(), index_name.size()),
+                             body.data(), body.size());
+
+  const uint64_t seq = segments_.rbegin()->first;
+  if (!write_fully(write_fd_, reinterpret_cast<const char*>(&header), sizeof(header)) ||
+      !write_fully(write_fd_, index_name.data(), index_name.size()) ||
+      !write_fully(write_fd_, body.data(), body.size()) ||
+      fdatasync(write_fd_) < 0) {
+    fprintf(stderr, "ERROR: write to ES spool segment %s: %s\n", segment_path(seq).c_str(), strerror(errno));
+    // whatever made it to disk is torn, and skipped on replay
+    close(write_fd_);
+    write_fd_ = -1;
+    struct stat st;
+    if (stat(segment_path(seq).c_str(), &st) == 0) {
+      total_bytes_ += st.st_size - segments_[seq];
+      segments_[seq] = st.st_size;
+    }
+    return false;
+  }
+
+  segments_[seq] += record_bytes;
+  total_bytes_ += record_bytes;
+  return true;
+}
+
+bool ElasticSearchSpool::read_next(std::string *index_name, std::string *body, uint32_t *item_count) {
+  while (has_unread()) {
+    const uint64_t segment_size = segments_[ahead_seq_];
+    if (ahead_offset_ >= segment_size) {
+      // move on to the next segment
+      auto next = segments_.upper_bound(ahead_seq_);
+      ahead_seq_ = next->first;
+      ahead_offset_ = 0;
+      continue;
+    }
+
+    if (read_fd_ < 0 || read_fd_seq_ != ahead_seq_) {
+      if (read_fd_ >= 0)
+        close(read_fd_);
+      read_fd_ = open(segment_path(ahead_seq_).c_str(), O_RDONLY | O_CLOEXEC);
+      read_fd_seq_ = ahead_seq_;
+      if (read_fd_ < 0) {
+        fprintf(stderr, "ERROR: open ES spool segment %s: %s\n", segment_path(ahead_seq_).c_str(), strerror(errno));
+        return false;
+      }
+    }
+
+    RecordHeader header;
+    bool valid = pread_fully(read_fd_, reinterpret_cast<char*>(&header), sizeof(header), ahead_offset_) &&
+        header.magic == SPOOL_RECORD_MAGIC &&
+        sizeof(header) + header.index_len + header.body_len <= segment_size - ahead_offset_;
+    if (valid) {
+      index_name->resize(header.index_len);
+      body->resize(header.body_len);
+      valid = pread_fully(read_fd_, &(*index_name)[0], header.index_len, ahead_offset_ + sizeof(header)) &&
+          pread_fully(read_fd_, &(*body)[0], header.body_len, ahead_offset_ + sizeof(header) + header.index_len) &&
+          checksum(checksum(kChecksumSeed, index_name->data(), index_name->size()),
+                   body->data(), body->size()) == header.checksum;
+    }
+
+    if (!valid) {
+      // a torn write: nothing after it in this segment can be trusted
+      fprintf(stderr, "WARNING: skipping %" PRIu64 " corrupt byte(s) at the end of ES spool segment %s\n",
+              segment_size - ahead_offset_, segment_path(ahead_seq_).c_str());
+      ahead_offset_ = segment_size;
+      continue;
+    }
+
+    *item_count = header.item_count;
+    ahead_offset_ += sizeof(header) + header.index_len + header.body_len;
+    unpopped_.push_back(std::make_pair(ahead_seq_, ahead_offset_));
+    return true;
+  }
+
+  return false;
+}
+
+void ElasticSearchSpool::pop() {
+  if (unpopped_.empty())
+    return;
+
+  // the cursor skips whatever read_next() skipped on the way, e.g.
+  // torn writes and segment ends
+  read_seq_ = unpopped_.front().first;
+  read_offset_ = unpopped_.front().second;
+  unpopped_.pop_front();
+  save_cursor();
+  trim_head();
+
+  if (is_empty()) {
+    // start over with a fresh segment, so that disk space is reclaimed
+    // as soon as an outage is over
+    (void) open_new_segment();
+  }
+}
+
+std::string ElasticSearchSpool::segment_path(const uint64_t seq) const {
+  char name[64];
+  snprintf(name, sizeof(name), "/segment-%.20" PRIu64, seq);
+  return directory_ + name;
+}
+
+std::string ElasticSearchSpool::cursor_path() const {
+  return directory_ + "/cursor";
+}
+
+bool ElasticSearchSpool::open_new_segment() {
+  const uint64_t seq = segments_.empty() ? 0 : segments_.rbegin()->first + 1;
+  const int fd = open(segment_path(seq).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: open ES spool segment %s: %s\n", segment_path(seq).c_str(), strerror(errno));
+    return false;
+  }
+
+  if (write_fd_ >= 0)
+    close(write_fd_);
+  write_fd_ = fd;
+
+  const bool was_empty = is_empty();
+  segments_[seq] = 0;
+  if (was_empty) {
+    // everything before the new segment has been replayed
+    read_seq_ = seq;
+    read_offset_ = 0;
+    ahead_seq_ = seq;
+    ahead_offset_ = 0;
+    save_cursor();
+  }
+  trim_head();
+  return true;
+}
+
+void ElasticSearchSpool::trim_head() {
+  while (!segments_.empty() && segments_.begin()->first < read_seq_) {
+    const uint64_t seq = segments_.begin()->first;
+    if (unlink(segment_path(seq).c_str()) < 0 && errno != ENOENT)
+      fprintf(stderr, "WARNING: unlink ES spool segment %s: %s\n", segment_path(seq).c_str(), strerror(errno));
+    total_bytes_ -= segments_.begin()->second;
+    segments_.erase(segments_.begin());
+  }
+}
+
+void ElasticSearchSpool::save_cursor() {
+  // write and rename, so that the cursor file is never torn; a stale
+  // cursor only means replaying a few payloads twice
+  const std::string tmp_path = cursor_path() + ".tmp";
+  FILE *fp = fopen(tmp_path.c_str(), "w");
+  if (!fp) {
+    fprintf(stderr, "WARNING: fopen %s: %s\n", tmp_path.c_str(), strerror(errno));
+    return;
+  }
+  fprintf(fp, "%" PRIu64 " %" PRIu64 "\n", read_seq_, read_offset_);
+  if (fclose(fp) != 0 || rename(tmp_path.c_str(), cursor_path().c_str()) < 0)
+    fprintf(stderr, "WARNING: saving ES spool cursor %s: %s\n", cursor_path().c_str(), strerror(errno));
+}
+
+void ElasticSearchSpool::load_cursor() {
+  FILE *fp = fopen(cursor_path().c_str(), "r");
+  if (!fp)
+    return;
+  if (fscanf(fp, "%" SCNu64 " %" SCNu64, &read_seq_, &read_offset_) != 2) {
+    read_seq_ = 0;
+    read_offset_ = 0;
+  }
+  fclose(fp);
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,97 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace freud {
+namespace lib {
+
+// Disk-backed FIFO of _bulk payloads that could not be delivered to
+// ES. Payloads are appended to segment files under a directory; a
+// cursor file tracks the next payload to replay, and segments are
+// deleted once fully replayed. Several payloads can be read ahead of
+// the cursor, so that they are replayed concurrently; they are popped
+// in order. Delivery is at-least-once: payloads replayed right before
+// a crash may be replayed again on restart. Not thread-safe.
+class ElasticSearchSpool {
+ public:
+  ElasticSearchSpool(const std::string &directory, const uint64_t max_bytes, const uint64_t segment_bytes);
+  ~ElasticSearchSpool();
+
+  // create the directory if needed, and pick up any payloads left by
+  // a previous run
+  bool init();
+
+  // true once every payload has been popped
+  bool is_empty() const;
+  // true if some payload has not been read yet
+  bool has_unread() const;
+  // bytes held on disk, including payloads already replayed but not
+  // yet deleted
+  uint64_t get_bytes() const { return total_bytes_; }
+  uint64_t get_max_bytes() const { return max_bytes_; }
+
+  // returns false if the payload does not fit, or on I/O errors; a
+  // successful append is on disk already
+  bool append(const std::string &index_name, const std::string &body, const uint32_t item_count);
+  // read the oldest payload not read yet; returns false if there is
+  // none
+  bool read_next(std::string *index_name, std::string *body, uint32_t *item_count);
+  // drop the oldest payload returned by read_next()
+  void pop();
+
+ private:
+  const std::string directory_;
+  const uint64_t max_bytes_;
+  const uint64_t segment_bytes_;
+
+  // segment sequence number -> size in bytes, oldest first; the last
+  // one is being written
+  std::map<uint64_t, uint64_t> segments_;
+  uint64_t total_bytes_;
+  int write_fd_;
+
+  // cursor: the oldest payload not popped yet
+  uint64_t read_seq_;
+  uint64_t read_offset_;
+  // the next payload to read, at or after the cursor
+  uint64_t ahead_seq_;
+  uint64_t ahead_offset_;
+  int read_fd_;
+  uint64_t read_fd_seq_;
+  // where each payload read but not popped yet ends, oldest first
+  std::deque<std::pair<uint64_t, uint64_t>> unpopped_;
+
+  std::string segment_path(const uint64_t seq) const;
+  std::string cursor_path() const;
+  bool open_new_segment();
+  // delete fully replayed segments, except the one being written
+  void trim_head();
+  void save_cursor();
+  void load_cursor();
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,204 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/json_writer.h"
+
+#include <math.h>
+#include <charconv>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace freud {
+namespace lib {
+
+namespace {
+
+const char kDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const char kHexDigits[] = "0123456789abcdef";
+
+// true for the bytes that must be escaped inside a JSON string
+inline bool needs_escape(const unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+} // namespace
+
+size_t format_uint64(uint64_t v, char *buf) {
+  // write backwards, two digits at a time, then move to the front
+  char tmp[20];
+  char *p = tmp + sizeof(tmp);
+  while (v >= 100) {
+    const unsigned pair = (v % 100) * 2;
+    v /= 100;
+    *--p = kDigitPairs[pair + 1];
+    *--p = kDigitPairs[pair];
+  }
+  if (v >= 10) {
+    *--p = kDigitPairs[v * 2 + 1];
+    *--p = kDigitPairs[v * 2];
+  } else {
+    *--p = '0' + v;
+  }
+
+  const size_t len = tmp + sizeof(tmp) - p;
+  memcpy(buf, p, len);
+  return len;
+}
+
+size_t format_double(const double v, char *buf) {
+  // shortest representation that parses back to v (Ryu), in plain or
+  // exponent notation, whichever is shorter
+  return std::to_chars(buf, buf + 32, v).ptr - buf;
+}
+
+size_t format_float(const float v, char *buf) {
+  // same as above, shortest for a float: 0.1f shows as 0.1, not as
+  // 0.100000001
+  return std::to_chars(buf, buf + 32, v).ptr - buf;
+}
+
+void JsonWriter::key(const char *k, const size_t len, const char *prefix) {
+  separate();
+  out_->push_back('"');
+  if (prefix)
+    append_escaped(prefix, strlen(prefix));
+  append_escaped(k, len);
+  out_->append("\":", 2);
+  need_comma_ = false;
+}
+
+void JsonWriter::value_int(const int64_t v) {
+  separate();
+  char buf[32];
+  if (v < 0) {
+    buf[0] = '-';
+    // negate as unsigned, so that INT64_MIN works too
+    out_->append(buf, 1 + format_uint64(-(uint64_t) v, buf + 1));
+  } else {
+    out_->append(buf, format_uint64(v, buf));
+  }
+  need_comma_ = true;
+}
+
+void JsonWriter::value_uint(const uint64_t v) {
+  separate();
+  char buf[32];
+  out_->append(buf, format_uint64(v, buf));
+  need_comma_ = true;
+}
+
+void JsonWriter::value_double(const double v) {
+  if (!isfinite(v)) {
+    value_null();
+    return;
+  }
+
+  separate();
+  char buf[32];
+  out_->append(buf, format_double(v, buf));
+  need_comma_ = true;
+}
+
+void JsonWriter::value_float(const float v) {
+  if (!isfinite(v)) {
+    value_null();
+    return;
+  }
+
+  separate();
+  char buf[32];
+  out_->append(buf, format_float(v, buf));
+  need_comma_ = true;
+}
+
+void JsonWriter::value_string(const char *s, const size_t len) {
+  separate();
+  out_->push_back('"');
+  append_escaped(s, len);
+  out_->push_back('"');
+  need_comma_ = true;
+}
+
+void JsonWriter::value_null() {
+  separate();
+  out_->append("null", 4);
+  need_comma_ = true;
+}
+
+void JsonWriter::append_escaped(const char *s, const size_t len) {
+  const char *end = s + len;
+  while (s < end) {
+    // find the next byte to escape, copying everything before it at once
+    const char *run = s;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while (end - run >= 16) {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(run));
+      // unsigned c <= 0x1f iff max(c, 0x1f) == 0x1f
+      const __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+          _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+      const int mask = _mm_movemask_epi8(special);
+      if (mask) {
+        run += __builtin_ctz(mask);
+        break;
+      }
+      run += 16;
+    }
+#endif
+    while (run < end && !needs_escape(*run))
+      ++run;
+
+    out_->append(s, run - s);
+    if (run == end)
+      break;
+
+    const unsigned char c = *run;
+    switch (c) {
+      case '"': out_->append("\\\"", 2); break;
+      case '\\': out_->append("\\\\", 2); break;
+      case '\n': out_->append("\\n", 2); break;
+      case '\r': out_->append("\\r", 2); break;
+      case '\t': out_->append("\\t", 2); break;
+      case '\b': out_->append("\\b", 2); break;
+      case '\f': out_->append("\\f", 2); break;
+      default: {
+        const char esc[6] = {'\\', 'u', '0', '0', kHexDigits[c >> 4], kHexDigits[c & 0xf]};
+        out_->append(esc, sizeof(esc));
+      }
+    }
+    s = run + 1;
+  }
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,80 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace freud {
+namespace lib {
+
+// Streaming JSON writer, appending compact JSON to a caller-owned
+// string; reusing the same string across documents means that, once
+// warmed up, writing a document does not allocate. The writer only
+// takes care of separators: callers are responsible for emitting a
+// well-formed sequence of keys and values.
+class JsonWriter {
+ public:
+  explicit JsonWriter(std::string *out) : out_(out), need_comma_(false) {}
+  ~JsonWriter() = default;
+
+  void begin_object() { separate(); out_->push_back('{'); need_comma_ = false; }
+  void end_object() { out_->push_back('}'); need_comma_ = true; }
+  void begin_array() { separate(); out_->push_back('['); need_comma_ = false; }
+  void end_array() { out_->push_back(']'); need_comma_ = true; }
+
+  // keys are escaped like any other string; prefix, if any, is
+  // prepended to the key without building a temporary string
+  void key(const char *k, const size_t len, const char *prefix = NULL);
+  void key(const char *k) { key(k, strlen(k)); }
+  void key(const std::string &k, const char *prefix = NULL) { key(k.data(), k.size(), prefix); }
+
+  void value_int(const int64_t v);
+  void value_uint(const uint64_t v);
+  // shortest representation that parses back to the same value; JSON
+  // has no NaN or infinities, these become null
+  void value_double(const double v);
+  void value_float(const float v);
+  void value_string(const char *s, const size_t len);
+  void value_string(const char *s) { value_string(s, strlen(s)); }
+  void value_string(const std::string &s) { value_string(s.data(), s.size()); }
+  void value_null();
+
+ private:
+  std::string *const out_;
+  bool need_comma_;
+
+  void separate() {
+    if (need_comma_)
+      out_->push_back(',');
+  }
+  // append s, escaped, without quotes
+  void append_escaped(const char *s, const size_t len);
+};
+
+// helpers for the formatting routines of JsonWriter; both return the
+// number of characters written into buf, which must hold at least 32
+size_t format_uint64(uint64_t v, char *buf);
+size_t format_double(const double v, char *buf);
+size_t format_float(const float v, char *buf);
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,96 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/msg_pool.h"
+
+#include <stdio.h>
+
+namespace freud {
+namespace lib {
+
+void MsgBuffer::unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    // last reference gone
+    pool_->release(this);
+}
+
+MsgPool::MsgPool(const size_t capacity)
+    : capacity_(capacity), slab_(new MsgBuffer[capacity]), exhausted_count_(0) {
+  free_.reserve(capacity_);
+  // push in reverse order, so that buffers are handed out starting
+  // from the beginning of the slab
+  for (size_t i = capacity_; i > 0; --i)
+    free_.push_back(&slab_[i - 1]);
+}
+
+MsgPool::~MsgPool() {
+  if (free_.size() != capacity_)
+    fprintf(stderr, "WARNING: message pool destroyed with %zu buffers in use\n", capacity_ - free_.size());
+  delete[] slab_;
+}
+
+MsgBuffer* MsgPool::acquire() {
+  std::lock_guard<std::mutex> lock_guard(mutex_);
+  if (free_.empty()) {
+    exhausted_count_.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+
+  MsgBuffer *buf = free_.back();
+  free_.pop_back();
+  init(buf);
+  return buf;
+}
+
+size_t MsgPool::acquire_batch(MsgBuffer **bufs, const size_t count) {
+  std::lock_guard<std::mutex> lock_guard(mutex_);
+  if (free_.empty()) {
+    exhausted_count_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  size_t acquired = 0;
+  while (acquired < count && !free_.empty()) {
+    bufs[acquired] = free_.back();
+    free_.pop_back();
+    init(bufs[acquired++]);
+  }
+  return acquired;
+}
+
+void MsgPool::init(MsgBuffer *buf) {
+  buf->pool_ = this;
+  buf->refs_.store(1, std::memory_order_relaxed);
+  buf->size_ = 0;
+  buf->decoded_ = NULL;
+  buf->replay_id_ = 0;
+}
+
+void MsgPool::release(MsgBuffer *buf) {
+  std::lock_guard<std::mutex> lock_guard(mutex_);
+  // capacity has been reserved upfront, this never allocates
+  free_.push_back(buf);
+}
+
+size_t MsgPool::get_available() {
+  std::lock_guard<std::mutex> lock_guard(mutex_);
+  return free_.size();
+}
+
+} // namespace lib
+} // namespace freud
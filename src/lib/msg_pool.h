@@ -0,0 +1,114 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace freud {
+namespace lib {
+
+class DecodedReport;
+class MsgPool;
+
+// a fixed-size buffer holding a single datagram; buffers are only
+// obtained from a MsgPool, and go back to it once the last reference
+// is dropped
+class MsgBuffer {
+ public:
+  // larger datagrams are truncated
+  static const size_t kCapacity = 2048;
+
+  char* data() { return data_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  void set_size(const size_t size) { size_ = size; }
+
+  // a buffer is acquired with one reference; every additional holder
+  // (e.g. each sink) must take its own
+  void add_ref(const uint32_t count = 1) { refs_.fetch_add(count, std::memory_order_relaxed); }
+  void unref();
+
+  // parsed form of the datagram, set by the decode stage; NULL until
+  // then
+  const DecodedReport* decoded() const { return decoded_; }
+  void set_decoded(const DecodedReport *decoded) { decoded_ = decoded; }
+
+  // the id of the DB cache row the datagram was replayed from, or 0 if
+  // it was just received
+  bool is_replayed() const { return replay_id_ != 0; }
+  int64_t get_replay_id() const { return replay_id_; }
+  void set_replay_id(const int64_t replay_id) { replay_id_ = replay_id; }
+
+ private:
+  friend class MsgPool;
+  // deliberately leaves all fields uninitialized, so that constructing
+  // the slab does not touch its pages; MsgPool sets them on acquire
+  MsgBuffer() {}
+
+  MsgPool *pool_;
+  std::atomic<uint32_t> refs_;
+  size_t size_;
+  const DecodedReport *decoded_;
+  int64_t replay_id_;
+  char data_[kCapacity];
+};
+
+// a slab of recycled message buffers; it never allocates after
+// construction
+class MsgPool {
+ public:
+  explicit MsgPool(const size_t capacity);
+  ~MsgPool();
+
+  // returns NULL if the pool is exhausted
+  MsgBuffer* acquire();
+  // acquire up to count buffers under a single lock; returns the
+  // number of buffers actually acquired
+  size_t acquire_batch(MsgBuffer **bufs, const size_t count);
+
+  size_t get_capacity() const { return capacity_; }
+  // position of buf in the slab, in [0, capacity)
+  size_t index_of(const MsgBuffer *buf) const { return buf - slab_; }
+  size_t get_available();
+  // number of times a buffer was requested from an empty pool
+  uint64_t get_exhausted_count() const { return exhausted_count_.load(std::memory_order_relaxed); }
+
+ private:
+  friend class MsgBuffer;
+
+  const size_t capacity_;
+  MsgBuffer *slab_;
+
+  std::mutex mutex_;
+  // LIFO, so that recently used (cache-hot) buffers are reused first;
+  // keeping the free list out of the slab also means that slab pages
+  // are only touched once they are actually needed
+  std::vector<MsgBuffer*> free_;
+  std::atomic<uint64_t> exhausted_count_;
+
+  void init(MsgBuffer *buf);
+  void release(MsgBuffer *buf);
+};
+
+} // namespace lib
+} // namespace freud
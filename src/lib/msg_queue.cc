@@ -0,0 +1,143 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/msg_queue.h"
+
+#include <inttypes.h>
+
+namespace freud {
+namespace lib {
+
+DropStats::DropStats() {
+  for (size_t i = 0; i < REPORT_CLASS_COUNT; ++i) {
+    counters_[i].msgs = 0;
+    counters_[i].bytes = 0;
+  }
+}
+
+void DropStats::count(const char *data, const size_t len) {
+  const ReportClass rc = peek_report_class(data, len);
+  counters_[rc].msgs.fetch_add(1, std::memory_order_relaxed);
+  counters_[rc].bytes.fetch_add(len, std::memory_order_relaxed);
+}
+
+void DropStats::dump(FILE *fp, const char *what) const {
+  for (size_t i = 0; i < REPORT_CLASS_COUNT; ++i) {
+    const ReportClass rc = static_cast<ReportClass>(i);
+    fprintf(fp, "STATS: %s dropped %s reports: %" PRIu64 " msgs, %" PRIu64 " bytes\n",
+            what, report_class_name(rc), get_msgs(rc), get_bytes(rc));
+  }
+}
+
+MsgQueue::MsgQueue(const Configurator::QueueConfig &config, DropStats *drops, const size_t max_msgs,
+                   ByteBudget *shared_budget, Doorbell *bell)
+    : queue_(max_msgs, bell), max_msgs_(max_msgs), queued_msgs_(0),
+      budget_(config.high_watermark_bytes, config.low_watermark_bytes),
+      drop_oldest_(config.drop_oldest), drops_(drops), shared_budget_(shared_budget) {
+}
+
+bool MsgQueue::push_deferred(MsgBuffer *msg) {
+  const size_t size = msg->size();
+
+  // make room in this queue first; with drop_oldest, evict messages
+  // from the head of the queue until the new one fits
+  while (!budget_.try_reserve(size)) {
+    if (!drop_oldest_ || !evict_oldest()) {
+      drop(msg);
+      return false;
+    }
+  }
+
+  // then in the shared budget, if any
+  if (shared_budget_ && !shared_budget_->try_reserve(size)) {
+    budget_.release(size);
+    drop(msg);
+    return false;
+  }
+
+  while (!try_reserve_slot()) {
+    // out of slots
+    if (!drop_oldest_ || !evict_oldest()) {
+      uncharge(*msg);
+      drop(msg);
+      return false;
+    }
+  }
+
+  // the ring is at least as large as max_msgs_, and every message in
+  // it holds a slot: this cannot fail
+  if (!queue_.push_deferred(msg)) {
+    queued_msgs_.fetch_sub(1, std::memory_order_relaxed);
+    uncharge(*msg);
+    drop(msg);
+    return false;
+  }
+
+  return true;
+}
+
+size_t MsgQueue::nonblocking_pop_batch(MsgBuffer **msgs, const size_t max_items) {
+  const size_t count = queue_.nonblocking_pop_batch(msgs, max_items);
+  for (size_t i = 0; i < count; ++i)
+    uncharge(*msgs[i]);
+  queued_msgs_.fetch_sub(count, std::memory_order_relaxed);
+  return count;
+}
+
+size_t MsgQueue::pop_batch(MsgBuffer **msgs, const size_t max_items, const int64_t max_wait_usec,
+                           const int64_t first_wait_usec) {
+  const size_t count = queue_.pop_batch(msgs, max_items, max_wait_usec, first_wait_usec);
+  for (size_t i = 0; i < count; ++i)
+    uncharge(*msgs[i]);
+  queued_msgs_.fetch_sub(count, std::memory_order_relaxed);
+  return count;
+}
+
+bool MsgQueue::evict_oldest() {
+  MsgBuffer *oldest = queue_.nonblocking_pop();
+  if (!oldest)
+    return false;
+
+  uncharge(*oldest);
+  queued_msgs_.fetch_sub(1, std::memory_order_relaxed);
+  drop(oldest);
+  return true;
+}
+
+bool MsgQueue::try_reserve_slot() {
+  size_t queued = queued_msgs_.load(std::memory_order_relaxed);
+  do {
+    if (queued >= max_msgs_)
+      return false;
+  } while (!queued_msgs_.compare_exchange_weak(queued, queued + 1, std::memory_order_relaxed));
+  return true;
+}
+
+void MsgQueue::uncharge(const MsgBuffer &msg) {
+  budget_.release(msg.size());
+  if (shared_budget_)
+    shared_budget_->release(msg.size());
+}
+
+void MsgQueue::drop(MsgBuffer *msg) {
+  drops_->count(*msg);
+  msg->unref();
+}
+
+} // namespace lib
+} // namespace freud
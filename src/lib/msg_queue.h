@@ -0,0 +1,105 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include "lib/byte_budget.h"
+#include "lib/configurator.h"
+#include "lib/msg_pool.h"
+#include "lib/report_peek.h"
+#include "lib/ring_queue.h"
+
+namespace freud {
+namespace lib {
+
+// exact counters of dropped messages, per report class
+class DropStats {
+ public:
+  DropStats();
+  ~DropStats() = default;
+
+  void count(const char *data, const size_t len);
+  void count(const MsgBuffer &msg) { count(msg.data(), msg.size()); }
+
+  uint64_t get_msgs(const ReportClass rc) const { return counters_[rc].msgs.load(std::memory_order_relaxed); }
+  uint64_t get_bytes(const ReportClass rc) const { return counters_[rc].bytes.load(std::memory_order_relaxed); }
+
+  void dump(FILE *fp, const char *what) const;
+
+ private:
+  struct {
+    std::atomic<uint64_t> msgs;
+    std::atomic<uint64_t> bytes;
+  } counters_[REPORT_CLASS_COUNT];
+};
+
+// hard cap on queued messages, regardless of their size
+#define MSG_QUEUE_SLOTS 16384
+
+// A bounded queue of message buffers: a hard cap on slots, plus a byte
+// budget with a drop policy. Messages that do not fit (or that get
+// evicted to make room) are counted in a DropStats, and unref'd.
+class MsgQueue {
+ public:
+  // shared_budget, if any, is charged after the queue's own budget;
+  // bell, if any, is shared with other queues
+  MsgQueue(const Configurator::QueueConfig &config, DropStats *drops, const size_t max_msgs = MSG_QUEUE_SLOTS,
+           ByteBudget *shared_budget = NULL, Doorbell *bell = NULL);
+  ~MsgQueue() = default;
+
+  // takes over the caller's reference to msg; returns false if msg has
+  // been dropped instead. The doorbell is not rung, see ring().
+  bool push_deferred(MsgBuffer *msg);
+  void ring() { queue_.ring(); }
+
+  // popped messages are no longer charged to any budget
+  size_t nonblocking_pop_batch(MsgBuffer **msgs, const size_t max_items);
+  // see RingQueue::pop_batch()
+  size_t pop_batch(MsgBuffer **msgs, const size_t max_items, const int64_t max_wait_usec,
+                   const int64_t first_wait_usec = -1);
+
+  void close() { queue_.close(); }
+  bool is_closed() const { return queue_.is_closed(); }
+  bool is_empty() const { return queue_.is_empty(); }
+  const ByteBudget& get_budget() const { return budget_; }
+  size_t get_queued_msgs() const { return queued_msgs_.load(std::memory_order_relaxed); }
+  size_t get_max_msgs() const { return max_msgs_; }
+
+ private:
+  RingQueue<MsgBuffer> queue_;
+  const size_t max_msgs_;
+  // slots taken, including pushes in progress; never above max_msgs_
+  std::atomic<size_t> queued_msgs_;
+  ByteBudget budget_;
+  const bool drop_oldest_;
+  DropStats *const drops_;
+  ByteBudget *const shared_budget_;
+
+  // evict the message at the head of the queue; returns false if the
+  // queue is empty
+  bool evict_oldest();
+  bool try_reserve_slot();
+  void uncharge(const MsgBuffer &msg);
+  void drop(MsgBuffer *msg);
+};
+
+} // namespace lib
+} // namespace freud
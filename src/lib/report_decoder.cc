@@ -0,0 +1,52 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/report_decoder.h"
+
+namespace freud {
+namespace lib {
+
+bool DecodedReport::decode(const char *data, const size_t len, const std::string *hostname) {
+  hostname_ = hostname;
+  // this also checks that all required fields are present
+  return pb_.ParseFromArray(data, len);
+}
+
+ReportDecoder::ReportDecoder(const MsgPool &pool, const std::string &hostname)
+    : pool_(pool), hostname_(hostname), reports_(pool.get_capacity(), NULL) {
+}
+
+ReportDecoder::~ReportDecoder() {
+  for (DecodedReport *report : reports_)
+    delete report;
+}
+
+bool ReportDecoder::decode(MsgBuffer *msg) {
+  DecodedReport *&report = reports_[pool_.index_of(msg)];
+  if (!report)
+    report = new DecodedReport();
+
+  if (!report->decode(msg->data(), msg->size(), &hostname_))
+    return false;
+
+  msg->set_decoded(report);
+  return true;
+}
+
+} // namespace lib
+} // namespace freud
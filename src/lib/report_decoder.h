@@ -0,0 +1,78 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "lib/freud-data.pb.h"
+#include "lib/msg_pool.h"
+
+namespace freud {
+namespace lib {
+
+// A report parsed by the decode stage; sinks share it read-only, for
+// as long as they hold a reference to the message buffer it belongs
+// to.
+class DecodedReport {
+ public:
+  DecodedReport() : hostname_(NULL) {}
+  ~DecodedReport() = default;
+
+  // returns false if data does not hold a valid report; the previous
+  // content is discarded either way, but the memory backing it is
+  // reused
+  bool decode(const char *data, const size_t len, const std::string *hostname);
+
+  const freudpb::Report& get_report() const { return pb_; }
+
+  // routing metadata
+  freudpb::Report::ReportType get_type() const { return pb_.type(); }
+  uint64_t get_usec_ts() const { return pb_.usec_ts(); }
+  const std::string& get_module_name() const { return pb_.module_name(); }
+  // name of the host the report was collected on
+  const std::string& get_hostname() const { return *hostname_; }
+
+ private:
+  freudpb::Report pb_;
+  const std::string *hostname_;
+};
+
+// Parses the messages of a single MsgPool, keeping one DecodedReport
+// per buffer of the pool: a report lives exactly as long as its buffer
+// does, and once warmed up, decoding no longer allocates.
+class ReportDecoder {
+ public:
+  ReportDecoder(const MsgPool &pool, const std::string &hostname);
+  ~ReportDecoder();
+
+  // on success, attaches the parsed report to msg
+  __attribute__((warn_unused_result))
+  bool decode(MsgBuffer *msg);
+
+ private:
+  const MsgPool &pool_;
+  const std::string &hostname_;
+  // allocated lazily, by buffer index
+  std::vector<DecodedReport*> reports_;
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,74 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/report_filter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace freud {
+namespace lib {
+
+ReportFilter::ReportFilter(const Configurator &config)
+    : modules_(config.get_filter().modules), pgnames_(config.get_filter().pgnames), peek_fields_(0) {
+  drop_class_[REPORT_CLASS_SUMMARY] = config.get_filter().drop_summary;
+  drop_class_[REPORT_CLASS_DETAILED] = config.get_filter().drop_detailed;
+  drop_class_[REPORT_CLASS_UNKNOWN] = false;
+
+  // detailed reports are only ever cached in the DB, or forwarded to ES
+  // on request; if neither happens, do not even queue them
+  if (!config.get_cache_packets_in_db() &&
+      !(config.get_send_packets_to_es() && config.fwd_detailed_reports()) &&
+      !drop_class_[REPORT_CLASS_DETAILED]) {
+    drop_class_[REPORT_CLASS_DETAILED] = true;
+    fprintf(stderr, "NOTICE: no sink takes detailed reports, discarding them on receipt\n");
+  }
+
+  if (!modules_.empty())
+    peek_fields_ |= PEEK_MODULE_NAME;
+  if (!pgnames_.empty())
+    peek_fields_ |= PEEK_PGNAME;
+}
+
+bool ReportFilter::is_filtered(const ReportPeek &peek) const {
+  if (peek.rc == REPORT_CLASS_UNKNOWN)
+    return false;
+
+  if (drop_class_[peek.rc])
+    return true;
+
+  if (peek.module_name && matches(modules_, peek.module_name, peek.module_name_len))
+    return true;
+
+  if (peek.pgname && matches(pgnames_, peek.pgname, peek.pgname_len))
+    return true;
+
+  return false;
+}
+
+bool ReportFilter::matches(const std::vector<std::string> &names, const char *name, const size_t len) {
+  // lists are expected to be short, and this avoids building a string
+  // out of the datagram
+  for (const std::string &n : names)
+    if (n.size() == len && memcmp(n.data(), name, len) == 0)
+      return true;
+  return false;
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,54 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "lib/configurator.h"
+#include "lib/report_peek.h"
+
+namespace freud {
+namespace lib {
+
+// Decides, from the wire format alone, which inbound reports are not
+// worth queueing at all.
+class ReportFilter {
+ public:
+  explicit ReportFilter(const Configurator &config);
+  ~ReportFilter() = default;
+
+  // PEEK_* fields that is_filtered() needs from peek_report()
+  unsigned get_peek_fields() const { return peek_fields_; }
+
+  // malformed reports are never filtered here, so that the decode
+  // stage accounts for them
+  bool is_filtered(const ReportPeek &peek) const;
+
+ private:
+  bool drop_class_[REPORT_CLASS_COUNT];
+  const std::vector<std::string> modules_;
+  const std::vector<std::string> pgnames_;
+  unsigned peek_fields_;
+
+  static bool matches(const std::vector<std::string> &names, const char *name, const size_t len);
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,144 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/report_peek.h"
+
+#include <stdint.h>
+
+// field numbers from freud-data.proto
+#define REPORT_FIELD_PGNAME 3
+#define REPORT_FIELD_TYPE 4
+#define REPORT_FIELD_MODULE_NAME 6
+
+// protobuf wire types
+#define WIRETYPE_VARINT 0
+#define WIRETYPE_FIXED64 1
+#define WIRETYPE_LENGTH_DELIMITED 2
+#define WIRETYPE_FIXED32 5
+
+namespace freud {
+namespace lib {
+
+namespace {
+
+// returns false on truncated or overlong varints
+bool read_varint(const uint8_t **p, const uint8_t *end, uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*p >= end)
+      return false;
+
+    const uint8_t byte = *(*p)++;
+    result |= ((uint64_t) (byte & 0x7f)) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+const char* report_class_name(const ReportClass rc) {
+  switch (rc) {
+    case REPORT_CLASS_SUMMARY:
+      return "summary";
+    case REPORT_CLASS_DETAILED:
+      return "detailed";
+    case REPORT_CLASS_UNKNOWN:
+    case REPORT_CLASS_COUNT:
+      break;
+  }
+  return "unknown";
+}
+
+void peek_report(const char *data, const size_t len, const unsigned fields, ReportPeek *peek) {
+  const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t *end = p + len;
+
+  // the type is a required field
+  peek->rc = REPORT_CLASS_UNKNOWN;
+  peek->pgname = NULL;
+  peek->pgname_len = 0;
+  peek->module_name = NULL;
+  peek->module_name_len = 0;
+
+  bool type_found = false;
+  unsigned missing = fields & (PEEK_PGNAME | PEEK_MODULE_NAME);
+  while (p < end && (!type_found || missing)) {
+    uint64_t key, value;
+    if (!read_varint(&p, end, &key))
+      break;
+
+    switch (key & 0x7) {
+      case WIRETYPE_VARINT:
+        if (!read_varint(&p, end, &value))
+          return;
+        if ((key >> 3) == REPORT_FIELD_TYPE) {
+          if (value == REPORT_CLASS_SUMMARY || value == REPORT_CLASS_DETAILED)
+            peek->rc = static_cast<ReportClass>(value);
+          else
+            // malformed reports do not need any other field
+            return;
+          type_found = true;
+        }
+        break;
+
+      case WIRETYPE_FIXED64:
+        if (end - p < 8)
+          return;
+        p += 8;
+        break;
+
+      case WIRETYPE_LENGTH_DELIMITED:
+        if (!read_varint(&p, end, &value) || value > (uint64_t) (end - p))
+          return;
+        if ((key >> 3) == REPORT_FIELD_PGNAME && (missing & PEEK_PGNAME)) {
+          peek->pgname = reinterpret_cast<const char*>(p);
+          peek->pgname_len = value;
+          missing &= ~PEEK_PGNAME;
+        } else if ((key >> 3) == REPORT_FIELD_MODULE_NAME && (missing & PEEK_MODULE_NAME)) {
+          peek->module_name = reinterpret_cast<const char*>(p);
+          peek->module_name_len = value;
+          missing &= ~PEEK_MODULE_NAME;
+        }
+        p += value;
+        break;
+
+      case WIRETYPE_FIXED32:
+        if (end - p < 4)
+          return;
+        p += 4;
+        break;
+
+      default:
+        // groups are not used by freud-data.proto
+        return;
+    }
+  }
+}
+
+ReportClass peek_report_class(const char *data, const size_t len) {
+  ReportPeek peek;
+  peek_report(data, len, 0, &peek);
+  return peek.rc;
+}
+
+} // namespace lib
+} // namespace freud
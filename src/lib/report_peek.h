@@ -0,0 +1,62 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace freud {
+namespace lib {
+
+// classes of inbound messages, as far as the ingest path is concerned;
+// the first two match the values of freudpb::Report::ReportType
+enum ReportClass {
+  REPORT_CLASS_SUMMARY = 0,
+  REPORT_CLASS_DETAILED = 1,
+  REPORT_CLASS_UNKNOWN = 2, // malformed, or unknown report type
+
+  REPORT_CLASS_COUNT
+};
+
+const char* report_class_name(const ReportClass rc);
+
+// fields that peek_report() may extract besides the report class
+#define PEEK_PGNAME 0x1
+#define PEEK_MODULE_NAME 0x2
+
+// the few fields of a report that the ingest path cares about; strings
+// point into the serialized report, and are not NUL-terminated
+struct ReportPeek {
+  ReportClass rc;
+  const char *pgname; // NULL if missing, or not requested
+  size_t pgname_len;
+  const char *module_name; // NULL if missing, or not requested
+  size_t module_name_len;
+};
+
+// Extract the report class, plus the requested PEEK_* fields, of a
+// serialized freudpb::Report by looking at its wire format only: no
+// parsing, no allocations. The scan stops as soon as all requested
+// fields have been found.
+void peek_report(const char *data, const size_t len, const unsigned fields, ReportPeek *peek);
+
+// same as above, for the report class only
+ReportClass peek_report_class(const char *data, const size_t len);
+
+} // namespace lib
+} // namespace freud
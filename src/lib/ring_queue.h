@@ -0,0 +1,272 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include "lib/doorbell.h"
+
+#define RING_QUEUE_CACHE_LINE 64
+
+namespace freud {
+namespace lib {
+
+// Bounded lock-free MPMC queue of pointers (Vyukov's sequenced ring).
+// The capacity is rounded up to a power of two; pushing into a full
+// queue fails, i.e. the queue tail-drops. Consumers sleep on a futex
+// only when the queue is empty.
+template <typename T>
+class RingQueue {
+ public:
+  // several queues may share an external doorbell, so that a single
+  // consumer can sleep on all of them at once
+  explicit RingQueue(const size_t capacity, Doorbell *bell = NULL)
+      : mask_(round_up_pow2(capacity) - 1), cells_(new Cell[mask_ + 1]),
+        enqueue_pos_(0), dequeue_pos_(0), closed_(false), bell_(bell ? bell : &own_bell_) {
+    for (size_t i = 0; i <= mask_; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+  ~RingQueue() { delete[] cells_; }
+
+  size_t get_capacity() const { return mask_ + 1; }
+
+  __attribute__((warn_unused_result))
+  bool push(T *datum) {
+    if (!try_push(datum))
+      return false;
+
+    bell_->ring();
+    return true;
+  }
+
+  // same as push(), but it does not ring the doorbell: the caller is
+  // expected to call ring() once it is done pushing
+  __attribute__((warn_unused_result))
+  bool push_deferred(T *datum) {
+    return try_push(datum);
+  }
+
+  void ring() { bell_->ring(); }
+
+  // push as many data as possible, ringing the doorbell only once;
+  // returns the number of data pushed, starting from the first one,
+  // so that the caller can dispose of the tail-dropped ones
+  __attribute__((warn_unused_result))
+  size_t push_batch(T **data, const size_t count) {
+    size_t pushed = 0;
+    while (pushed < count && try_push(data[pushed]))
+      ++pushed;
+
+    if (pushed)
+      bell_->ring();
+    return pushed;
+  }
+
+  // returns NULL once the queue has been closed and drained, or once
+  // timeout_usec elapses (negative means forever)
+  T* pop_or_wait(const int64_t timeout_usec = -1) {
+    T *datum;
+    const int64_t deadline = timeout_usec >= 0 ? get_monotonic_usec() + timeout_usec : 0;
+    while (true) {
+      if (try_pop(&datum))
+        return datum;
+
+      int64_t remaining = -1;
+      if (timeout_usec >= 0) {
+        remaining = deadline - get_monotonic_usec();
+        if (remaining <= 0)
+          return NULL;
+      }
+
+      const uint32_t ticket = bell_->prepare_wait();
+      if (try_pop(&datum)) {
+        bell_->cancel_wait();
+        return datum;
+      }
+      if (closed_.load(std::memory_order_seq_cst)) {
+        bell_->cancel_wait();
+        return NULL;
+      }
+      bell_->wait(ticket, remaining);
+    }
+  }
+
+  // block until at least one datum is available, then pop up to
+  // max_items data, waiting at most max_wait_usec after the first one
+  // for more to arrive; returns 0 once the queue has been closed and
+  // drained, or if nothing arrived within first_wait_usec (negative
+  // means forever)
+  size_t pop_batch(T **data, const size_t max_items, const int64_t max_wait_usec,
+                   const int64_t first_wait_usec = -1) {
+    if (!max_items)
+      return 0;
+
+    T *first = pop_or_wait(first_wait_usec);
+    if (!first)
+      return 0;
+
+    size_t count = 0;
+    data[count++] = first;
+    const int64_t deadline = get_monotonic_usec() + max_wait_usec;
+    while (count < max_items) {
+      if (try_pop(&data[count])) {
+        ++count;
+        continue;
+      }
+
+      const int64_t now = get_monotonic_usec();
+      if (max_wait_usec <= 0 || now >= deadline)
+        break;
+
+      const uint32_t ticket = bell_->prepare_wait();
+      if (try_pop(&data[count])) {
+        bell_->cancel_wait();
+        ++count;
+        continue;
+      }
+      if (closed_.load(std::memory_order_seq_cst)) {
+        bell_->cancel_wait();
+        break;
+      }
+      bell_->wait(ticket, deadline - now);
+    }
+
+    return count;
+  }
+
+  T* nonblocking_pop() {
+    T *datum;
+    if (!try_pop(&datum))
+      // nothing to pop
+      return NULL;
+    return datum;
+  }
+
+  // pop up to max_items data without waiting
+  size_t nonblocking_pop_batch(T **data, const size_t max_items) {
+    size_t count = 0;
+    while (count < max_items && try_pop(&data[count]))
+      ++count;
+    return count;
+  }
+
+  // only a hint, unless producers are known to be quiescent
+  bool is_empty() const {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return cells_[pos & mask_].seq.load(std::memory_order_acquire) != pos + 1;
+  }
+
+  bool is_closed() const { return closed_.load(std::memory_order_seq_cst); }
+
+  // wake up all consumers; they will return NULL once the queue is
+  // empty
+  void close() {
+    closed_.store(true, std::memory_order_seq_cst);
+    bell_->ring_all();
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T *datum;
+  };
+
+  // read-only after construction
+  const size_t mask_;
+  Cell *const cells_;
+  char pad0_[RING_QUEUE_CACHE_LINE];
+  // producers only
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[RING_QUEUE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+  // consumers only
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[RING_QUEUE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+  std::atomic<bool> closed_;
+  Doorbell own_bell_;
+  Doorbell *const bell_;
+
+  static int64_t get_monotonic_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  static size_t round_up_pow2(const size_t n) {
+    size_t result = 2;
+    while (result < n)
+      result <<= 1;
+    return result;
+  }
+
+  bool try_push(T *datum) {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if (diff == 0) {
+        // the cell is free, try and claim it
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        // the cell still holds a datum from the previous lap: full
+        return false;
+      } else {
+        // another producer claimed the cell first
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->datum = datum;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T **datum) {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+      if (diff == 0) {
+        // the cell holds a datum, try and claim it
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        // the cell has not been written yet: empty
+        return false;
+      } else {
+        // another consumer claimed the cell first
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    *datum = cell->datum;
+    // make the cell available to the producers of the next lap
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,62 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "lib/msg_pool.h"
+
+namespace freud {
+namespace lib {
+
+// A destination for inbound reports. Each sink is driven by its own
+// SinkWorker thread, so implementations need not be thread-safe.
+class Sink {
+ public:
+  virtual ~Sink() = default;
+
+  virtual const char* get_sink_name() const = 0;
+
+  // returns the number of messages processed successfully; messages
+  // must not be retained past the call
+  virtual size_t consume_batch(MsgBuffer *const *msgs, const size_t count) = 0;
+
+  // called after every batch, and whenever the time last returned by
+  // tick() elapses with no new messages (idle is true then); sinks
+  // that buffer output, or have work in progress, use it to make
+  // progress on a timer. An idle sink may block briefly. Returns the
+  // usec until the next call is due, or a negative value if none is
+  // needed.
+  virtual int64_t tick(const bool /*idle*/) { return -1; }
+
+  // called once no more messages will be consumed
+  virtual void flush() {}
+
+  // the smallest replay id among the consumed messages whose output is
+  // still buffered, i.e. not yet delivered or spooled; INT64_MAX if
+  // there are none. Called from other threads.
+  virtual int64_t get_unsettled_replay_id() const { return INT64_MAX; }
+
+  // sink-specific "STATS:" lines
+  virtual void dump_stats(FILE * /*fp*/) const {}
+};
+
+} // namespace lib
+} // namespace freud
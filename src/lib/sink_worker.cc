@@ -0,0 +1,130 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/sink_worker.h"
+
+#include <inttypes.h>
+#include <algorithm>
+#include <vector>
+
+namespace freud {
+namespace lib {
+
+// the batch being consumed counts against max_msgs too: cap it to half
+// of the budget, and leave the rest to the queue
+static uint32_t cap_batch_size(const size_t max_msgs, const uint32_t batch_size) {
+  const size_t cap = max_msgs > 1 ? max_msgs / 2 : 1;
+  return batch_size < cap ? batch_size : cap;
+}
+
+SinkWorker::SinkWorker(Sink *sink, const Configurator::QueueConfig &queue_config, const size_t max_msgs,
+                       const uint32_t batch_size, const uint32_t batch_wait_usec)
+    : sink_(sink), queue_(queue_config, &drops_, max_msgs - cap_batch_size(max_msgs, batch_size)),
+      batch_size_(cap_batch_size(max_msgs, batch_size)), batch_wait_usec_(batch_wait_usec),
+      processed_msgs_(0), failed_msgs_(0), consumed_replay_id_(0) {
+  worker_ = new std::thread(&SinkWorker::worker_fn, this);
+}
+
+SinkWorker::~SinkWorker() {
+  stop();
+  wait();
+}
+
+size_t SinkWorker::push_batch(MsgBuffer *const *msgs, const size_t count) {
+  size_t queued = 0;
+  for (size_t i = 0; i < count; ++i) {
+    msgs[i]->add_ref();
+    if (queue_.push_deferred(msgs[i]))
+      ++queued;
+  }
+
+  if (queued)
+    queue_.ring();
+  return queued;
+}
+
+void SinkWorker::stop() {
+  queue_.close();
+}
+
+void SinkWorker::wait() {
+  std::thread *local_worker = worker_;
+  worker_ = NULL;
+
+  if (!local_worker)
+    return;
+
+  local_worker->join();
+  delete local_worker;
+}
+
+void SinkWorker::dump_stats(FILE *fp) const {
+  const ByteBudget &budget = queue_.get_budget();
+  fprintf(fp, "STATS: %s sink: processed %" PRIu64 " msgs, failed %" PRIu64 " msgs\n",
+          sink_->get_sink_name(), processed_msgs_.load(), failed_msgs_.load());
+  fprintf(fp, "STATS: %s sink queue: used %" PRIu64 " bytes, high watermark %" PRIu64 ", low watermark %" PRIu64
+          ", %s, %zu msgs, limit %zu\n",
+          sink_->get_sink_name(), budget.get_used(), budget.get_high_watermark(), budget.get_low_watermark(),
+          budget.is_shedding() ? "shedding" : "admitting", queue_.get_queued_msgs(), queue_.get_max_msgs());
+
+  char what[64];
+  snprintf(what, sizeof(what), "%s sink", sink_->get_sink_name());
+  drops_.dump(fp, what);
+
+  sink_->dump_stats(fp);
+}
+
+void SinkWorker::worker_fn() {
+  std::vector<MsgBuffer*> batch(batch_size_);
+  // the sink might have work left from a previous run
+  int64_t tick_usec = sink_->tick(true);
+  while (true) {
+    const size_t count = queue_.pop_batch(batch.data(), batch_size_, batch_wait_usec_, tick_usec);
+    if (!count) {
+      if (queue_.is_closed() && queue_.is_empty())
+        // stop processing events
+        break;
+
+      // nothing new, but the sink asked for a tick
+      tick_usec = sink_->tick(true);
+      continue;
+    }
+
+    const size_t done = sink_->consume_batch(batch.data(), count);
+    processed_msgs_.fetch_add(done, std::memory_order_relaxed);
+    if (done != count) {
+      failed_msgs_.fetch_add(count - done, std::memory_order_relaxed);
+      fprintf(stderr, "WARNING: %s sink could not process %zu packet(s)\n", sink_->get_sink_name(), count - done);
+    }
+
+    int64_t replay_id = 0;
+    for (size_t i = 0; i < count; ++i) {
+      replay_id = std::max(replay_id, batch[i]->get_replay_id());
+      batch[i]->unref();
+    }
+    if (replay_id)
+      consumed_replay_id_.store(replay_id, std::memory_order_release);
+
+    tick_usec = sink_->tick(false);
+  }
+
+  sink_->flush();
+}
+
+} // namespace lib
+} // namespace freud
@@ -0,0 +1,77 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "lib/configurator.h"
+#include "lib/msg_queue.h"
+#include "lib/sink.h"
+
+namespace freud {
+namespace lib {
+
+// Feeds a single Sink from its own queue and thread, so that a slow
+// sink only ever fills (and drops from) its own queue.
+class SinkWorker {
+ public:
+  // max_msgs bounds the buffers held by the sink at any time, queued
+  // or being consumed, so that a stalled sink cannot starve the pools
+  // it shares with the other sinks
+  SinkWorker(Sink *sink, const Configurator::QueueConfig &queue_config, const size_t max_msgs,
+             const uint32_t batch_size, const uint32_t batch_wait_usec);
+  ~SinkWorker();
+
+  // takes a new reference on every message, the caller keeps its own;
+  // returns the number of messages queued
+  size_t push_batch(MsgBuffer *const *msgs, const size_t count);
+
+  // the worker exits once its queue has been drained
+  void stop();
+  void wait();
+
+  // bytes held by the queue of the sink
+  const ByteBudget& get_budget() const { return queue_.get_budget(); }
+
+  // replayed messages are queued in replay id order: every message up
+  // to the last consumed one is either settled, or accounted for by
+  // the sink
+  int64_t get_consumed_replay_id() const { return consumed_replay_id_.load(std::memory_order_acquire); }
+  int64_t get_unsettled_replay_id() const { return sink_->get_unsettled_replay_id(); }
+
+  void dump_stats(FILE *fp) const;
+
+ private:
+  Sink *const sink_;
+  DropStats drops_;
+  MsgQueue queue_;
+  const uint32_t batch_size_;
+  const uint32_t batch_wait_usec_;
+  std::thread *worker_;
+
+  std::atomic<uint64_t> processed_msgs_;
+  std::atomic<uint64_t> failed_msgs_;
+  std::atomic<int64_t> consumed_replay_id_;
+
+  void worker_fn();
+};
+
+} // namespace lib
+} // namespace freud
@@ -19,10 +19,16 @@
 #include "lib/threaded_udp_srv.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h> // for close
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
 
 #define UDP_FIRST_PORT 2377
 #define UDP_LAST_PORT 2548
@@ -30,8 +36,13 @@
 namespace freud {
 namespace lib {
 
-ThreadedUDPServer::ThreadedUDPServer(Dispatcher *dispatcher)
-    : dispatcher_(dispatcher), listener_(NULL), fd_(0), port_(0), shutting_down_(false) {
+ThreadedUDPServer::ThreadedUDPServer(const Configurator &config, Dispatcher *dispatcher)
+    : dispatcher_(dispatcher), batch_size_(config.get_udp_batch_size()),
+      port_(0), shutting_down_(false) {
+}
+
+ThreadedUDPServer::~ThreadedUDPServer() {
+  close_sockets();
 }
 
 uint16_t ThreadedUDPServer::start_listening() {
@@ -39,57 +50,99 @@ uint16_t ThreadedUDPServer::start_listening() {
   if (port_)
     return port_;
 
-  if (!try_init_socket())
+  if (!try_init_sockets())
     return 0;
 
   if (!try_bind_port())
     return 0;
 
   shutting_down_ = false;
-  listener_ = new std::thread(&ThreadedUDPServer::keep_listening, this);
+  for (size_t i = 0; i < fds_.size(); ++i)
+    listeners_.push_back(new std::thread(&ThreadedUDPServer::keep_listening, this, i));
   return port_;
 }
 
 void ThreadedUDPServer::stop_listening() {
-  if (!listener_)
+  if (listeners_.empty())
     // nothing to do here
     return;
 
-  std::thread *local_listener = listener_;
-  listener_ = NULL;
+  std::vector<std::thread*> local_listeners;
+  local_listeners.swap(listeners_);
 
   shutting_down_ = true;
-  if (::shutdown(fd_, SHUT_RDWR))
-    fprintf(stderr, "ERROR: shutdown: %s\n", strerror(errno));
+  for (const int fd : fds_)
+    if (::shutdown(fd, SHUT_RDWR))
+      fprintf(stderr, "ERROR: shutdown: %s\n", strerror(errno));
 
-  fprintf(stderr, "INFO: waiting for listener\n");
-  local_listener->join();
-  delete local_listener;
-  fprintf(stderr, "INFO: done waiting for listener\n");
+  fprintf(stderr, "INFO: waiting for %zu listener(s)\n", local_listeners.size());
+  for (std::thread *listener : local_listeners) {
+    listener->join();
+    delete listener;
+  }
+  fprintf(stderr, "INFO: done waiting for listeners\n");
 }
 
+void ThreadedUDPServer::dump_stats(FILE *fp) {
+  for (size_t i = 0; i < stats_.size(); ++i) {
+    const ListenerStats &stats = *stats_[i];
+    const uint64_t datagrams = stats.datagrams.load();
+    const uint64_t syscalls = stats.syscalls.load();
 
-bool ThreadedUDPServer::try_init_socket() {
-  if (fd_)
+    // CPU time is only available while the listener is running
+    double cpu_sec = 0;
+    clockid_t clock;
+    struct timespec ts;
+    if (i < listeners_.size() && !pthread_getcpuclockid(listeners_[i]->native_handle(), &clock) &&
+        !clock_gettime(clock, &ts))
+      cpu_sec = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    fprintf(fp, "STATS: listener %zu: %" PRIu64 " datagrams, %" PRIu64 " bytes, %" PRIu64
+            " receive calls (%.1f datagrams per call), %.3f s CPU (%.2f us per datagram)\n",
+            i, datagrams, stats.bytes.load(), syscalls, syscalls ? (double) datagrams / syscalls : 0.0,
+            cpu_sec, datagrams ? cpu_sec * 1e6 / datagrams : 0.0);
+  }
+}
+
+
+bool ThreadedUDPServer::try_init_sockets() {
+  if (!fds_.empty())
     // do not init twice
     return true;
 
-  int local_fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
-  if (local_fd < 0) {
-    // failed to initialize the socket
-    fprintf(stderr, "ERROR: socket: %s\n", strerror(errno));
-    return false;
-  }
+  const size_t shards = dispatcher_->get_shard_count();
+  for (size_t i = 0; i < shards; ++i) {
+    int local_fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (local_fd < 0) {
+      // failed to initialize the socket
+      fprintf(stderr, "ERROR: socket: %s\n", strerror(errno));
+      close_sockets();
+      return false;
+    }
 
-  // enable address reuse on socket
-  int val = 1;
-  if (::setsockopt(local_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
-    // failed to initialize the socket
-    fprintf(stderr, "ERROR: setsockopt: %s\n", strerror(errno));
-    return false;
+    // enable address reuse on socket
+    int val = 1;
+    if (::setsockopt(local_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
+      // failed to initialize the socket
+      fprintf(stderr, "ERROR: setsockopt: %s\n", strerror(errno));
+      ::close(local_fd);
+      close_sockets();
+      return false;
+    }
+
+    // with more than one shard, let the kernel spread flows across
+    // all the sockets bound to the same port
+    if (shards > 1 && ::setsockopt(local_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) < 0) {
+      fprintf(stderr, "ERROR: setsockopt(SO_REUSEPORT): %s\n", strerror(errno));
+      ::close(local_fd);
+      close_sockets();
+      return false;
+    }
+
+    fds_.push_back(local_fd);
+    stats_.push_back(new ListenerStats());
   }
 
-  fd_ = local_fd;
   return true;
 }
 
@@ -97,39 +150,90 @@ bool ThreadedUDPServer::try_bind_port() {
   if (port_)
     return true;
 
+  // the first socket looks for a free port...
   uint16_t local_port = UDP_FIRST_PORT;
   while (local_port < UDP_LAST_PORT) {
-    struct sockaddr_in serv_addr;
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;  /* IPv4 UDP server */
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(local_port);
-
-    int r = ::bind(fd_, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
-    if (r == 0) {
-      // bind successful
-      port_ = local_port;
-      return true;
-    }
+    if (bind_to_port(fds_[0], local_port))
+      break;
 
     // failed to bind, try again
     fprintf(stderr, "INFO: bind, port %d: %s\n", local_port, strerror(errno));
     ++local_port;
   }
 
-  // permanently failed to bind
-  fprintf(stderr, "ERROR: bind failed permanently\n");
-  return false;
+  if (local_port >= UDP_LAST_PORT) {
+    // permanently failed to bind
+    fprintf(stderr, "ERROR: bind failed permanently\n");
+    close_sockets();
+    return false;
+  }
+
+  // ...and all the others join it on the same port
+  for (size_t i = 1; i < fds_.size(); ++i) {
+    if (!bind_to_port(fds_[i], local_port)) {
+      fprintf(stderr, "ERROR: bind, shard %zu to port %d: %s\n", i, local_port, strerror(errno));
+      // a socket cannot be bound twice
+      close_sockets();
+      return false;
+    }
+  }
+
+  // bind successful
+  port_ = local_port;
+  return true;
+}
+
+void ThreadedUDPServer::close_sockets() {
+  for (const int fd : fds_)
+    if (::close(fd))
+      fprintf(stderr, "ERROR: close: %s\n", strerror(errno));
+  fds_.clear();
+
+  for (ListenerStats *stats : stats_)
+    delete stats;
+  stats_.clear();
+}
+
+bool ThreadedUDPServer::bind_to_port(const int fd, const uint16_t port) {
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;  /* IPv4 UDP server */
+  serv_addr.sin_addr.s_addr = INADDR_ANY;
+  serv_addr.sin_port = htons(port);
+
+  return ::bind(fd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) == 0;
 }
 
-void ThreadedUDPServer::keep_listening() {
-  // cache the FD locally
-  const int local_fd = fd_;
+void ThreadedUDPServer::keep_listening(const size_t shard) {
+  if (batch_size_ > 1)
+    keep_listening_batched(shard);
+  else
+    keep_listening_single(shard);
 
-  char buf[2048];
+  fprintf(stderr, "INFO: listener %zu stopping\n", shard);
+}
+
+void ThreadedUDPServer::keep_listening_single(const size_t shard) {
+  // cache the FD and the pool locally
+  const int local_fd = fds_[shard];
+  MsgPool *pool = dispatcher_->get_pool(shard);
+  ListenerStats &stats = *stats_[shard];
+
+  MsgBuffer *msg = NULL;
   while (true) {
-    ssize_t result = recvfrom(local_fd, buf, sizeof(buf), 0, NULL, NULL);
+    if (!msg && !(msg = pool->acquire())) {
+      // pool exhausted: the datagram still needs to be consumed, but
+      // it is going to be dropped
+      if (!drop_datagram(shard))
+        break;
+      continue;
+    }
+
+    ssize_t result = recvfrom(local_fd, msg->data(), MsgBuffer::kCapacity, 0, NULL, NULL);
+    stats.syscalls.fetch_add(1, std::memory_order_relaxed);
     if (result == -1) {
+      if (errno == EINTR)
+        continue;
       fprintf(stderr, "ERROR: recvfrom: %s\n", strerror(errno));
       break;
     }
@@ -146,11 +250,120 @@ void ThreadedUDPServer::keep_listening() {
     }
 
     //fprintf(stderr, "TRACE: recv %zd bytes\n", result);
-    std::string *s = new std::string(buf, result);
-    dispatcher_->msg_received(s);
+    stats.datagrams.fetch_add(1, std::memory_order_relaxed);
+    stats.bytes.fetch_add(result, std::memory_order_relaxed);
+    msg->set_size(result);
+    dispatcher_->msg_received(shard, msg);
+    msg = NULL;
+  }
+
+  if (msg)
+    msg->unref();
+}
+
+void ThreadedUDPServer::keep_listening_batched(const size_t shard) {
+  // cache the FD and the pool locally
+  const int local_fd = fds_[shard];
+  MsgPool *pool = dispatcher_->get_pool(shard);
+  ListenerStats &stats = *stats_[shard];
+
+  // headers are allocated once, and reused for every recvmmsg() call;
+  // buffers that did not receive anything are kept for the next call
+  std::vector<struct iovec> iovecs(batch_size_);
+  std::vector<struct mmsghdr> hdrs(batch_size_);
+  std::vector<MsgBuffer*> bufs(batch_size_);
+  std::vector<MsgBuffer*> msgs(batch_size_);
+  size_t held = 0;
+  memset(hdrs.data(), 0, hdrs.size() * sizeof(hdrs[0]));
+  for (size_t i = 0; i < batch_size_; ++i) {
+    hdrs[i].msg_hdr.msg_iov = &iovecs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (true) {
+    // top up the buffers for this round
+    if (held < batch_size_)
+      held += pool->acquire_batch(&bufs[held], batch_size_ - held);
+    if (!held) {
+      // pool exhausted: the datagram still needs to be consumed, but
+      // it is going to be dropped
+      if (!drop_datagram(shard))
+        break;
+      continue;
+    }
+    for (size_t i = 0; i < held; ++i) {
+      iovecs[i].iov_base = bufs[i]->data();
+      iovecs[i].iov_len = MsgBuffer::kCapacity;
+    }
+
+    // block until at least one datagram is available, then also
+    // collect whatever else is already queued on the socket
+    int result = recvmmsg(local_fd, hdrs.data(), held, MSG_WAITFORONE, NULL);
+    stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (result == -1) {
+      if (errno == EINTR)
+        // nothing received, the buffers are all still held
+        continue;
+      fprintf(stderr, "ERROR: recvmmsg: %s\n", strerror(errno));
+      break;
+    }
+
+    size_t count = 0;
+    size_t kept = 0;
+    uint64_t bytes = 0;
+    bool stop = false;
+    for (size_t i = 0; i < held; ++i) {
+      const unsigned int len = (int) i < result ? hdrs[i].msg_len : 0;
+      if (len == 0) {
+        // either not filled by this call, or same as in
+        // keep_listening_single(): a 0-length datagram, or shutdown()
+        // has been initiated
+        if ((int) i < result && shutting_down_)
+          stop = true;
+        bufs[kept++] = bufs[i];
+        continue;
+      }
+
+      bufs[i]->set_size(len);
+      msgs[count++] = bufs[i];
+      bytes += len;
+    }
+    held = kept;
+    stats.datagrams.fetch_add(count, std::memory_order_relaxed);
+    stats.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    //fprintf(stderr, "TRACE: recv %zu datagrams\n", count);
+    if (count)
+      dispatcher_->msgs_received(shard, msgs.data(), count);
+
+    if (stop) {
+      fprintf(stderr, "INFO: listener shutdown requested\n");
+      break;
+    }
   }
 
-  fprintf(stderr, "INFO: listener stopping\n");
+  for (size_t i = 0; i < held; ++i)
+    bufs[i]->unref();
+}
+
+bool ThreadedUDPServer::drop_datagram(const size_t shard) {
+  char buf[MsgBuffer::kCapacity];
+  ssize_t result = recvfrom(fds_[shard], buf, sizeof(buf), 0, NULL, NULL);
+  if (result == -1) {
+    if (errno == EINTR)
+      // the caller tries again
+      return true;
+    fprintf(stderr, "ERROR: recvfrom: %s\n", strerror(errno));
+    return false;
+  }
+  if (result == 0 && shutting_down_) {
+    fprintf(stderr, "INFO: listener shutdown requested\n");
+    return false;
+  }
+
+  if (result > 0)
+    dispatcher_->msg_dropped(shard, buf, result);
+  return true;
 }
 
 } // namespace lib
@@ -18,7 +18,11 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <atomic>
 #include <thread>
+#include <vector>
+#include "lib/configurator.h"
 #include "lib/dispatcher.h"
 
 namespace freud {
@@ -26,23 +30,51 @@ namespace lib {
 
 class ThreadedUDPServer {
  public:
-  explicit ThreadedUDPServer(Dispatcher *dispatcher);
-  ~ThreadedUDPServer() = default;
+  ThreadedUDPServer(const Configurator &config, Dispatcher *dispatcher);
+  ~ThreadedUDPServer();
 
   uint16_t start_listening();
   void stop_listening();
 
   uint16_t get_listening_port() const { return port_; }
 
+  // dump the per-listener counters
+  void dump_stats(FILE *fp);
+
  private:
-  bool try_init_socket();
+  // on failure, both leave no socket behind, so that they can be
+  // tried again from scratch
+  bool try_init_sockets();
   bool try_bind_port();
-  void keep_listening();
+  // close all sockets, and drop their counters
+  void close_sockets();
+  bool bind_to_port(const int fd, const uint16_t port);
+  void keep_listening(const size_t shard);
+  // one recvfrom() per datagram
+  void keep_listening_single(const size_t shard);
+  // up to batch_size_ datagrams per recvmmsg()
+  void keep_listening_batched(const size_t shard);
+  // consume one datagram without storing it anywhere; returns false
+  // if the listener should stop
+  bool drop_datagram(const size_t shard);
+
+  // per-listener counters, only ever written by their own listener
+  struct ListenerStats {
+    ListenerStats() : datagrams(0), bytes(0), syscalls(0) {}
+
+    std::atomic<uint64_t> datagrams;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> syscalls;
+  };
 
   Dispatcher *dispatcher_;
+  const uint32_t batch_size_;
 
-  std::thread *listener_;
-  int fd_;
+  // one socket and one listener per dispatcher shard; all sockets are
+  // bound to the same port
+  std::vector<std::thread*> listeners_;
+  std::vector<int> fds_;
+  std::vector<ListenerStats*> stats_;
   uint16_t port_;
   bool shutting_down_;
 };
@@ -0,0 +1,112 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lib/trace_dictionary.h"
+
+#include <inttypes.h>
+
+#define TRACE_DICTIONARY_NONE UINT32_MAX
+
+namespace freud {
+namespace lib {
+
+TraceDictionary::TraceDictionary(const size_t capacity)
+    : capacity_(capacity ? capacity : 1), head_(TRACE_DICTIONARY_NONE), tail_(TRACE_DICTIONARY_NONE),
+      size_(0), hits_(0), misses_(0), evictions_(0) {
+  // never grows past this, so memory stays flat
+  entries_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+bool TraceDictionary::insert(const uint64_t id) {
+  auto iter = index_.find(id);
+  if (iter != index_.end()) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    if (iter->second != head_) {
+      unlink(iter->second);
+      push_front(iter->second);
+    }
+    return false;
+  }
+
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  uint32_t pos;
+  if (entries_.size() < capacity_) {
+    pos = entries_.size();
+    entries_.push_back(Entry());
+    size_.store(entries_.size(), std::memory_order_relaxed);
+  } else {
+    // recycle the least recently used entry
+    pos = tail_;
+    unlink(pos);
+    index_.erase(entries_[pos].id);
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  entries_[pos].id = id;
+  push_front(pos);
+  index_.insert(std::make_pair(id, pos));
+  return true;
+}
+
+void TraceDictionary::dump_stats(FILE *fp, const char *name) const {
+  fprintf(fp, "STATS: %s: %zu entries, limit %zu, %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions\n",
+          name, size_.load(), capacity_, hits_.load(), misses_.load(), evictions_.load());
+}
+
+uint64_t TraceDictionary::hash(const uint64_t *pcs, const size_t count) {
+  // multiply-xorshift over the PCs, then the splitmix64 finalizer
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ count;
+  for (size_t i = 0; i < count; ++i) {
+    h ^= pcs[i];
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 31;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+void TraceDictionary::unlink(const uint32_t pos) {
+  Entry &entry = entries_[pos];
+  if (entry.prev != TRACE_DICTIONARY_NONE)
+    entries_[entry.prev].next = entry.next;
+  else
+    head_ = entry.next;
+  if (entry.next != TRACE_DICTIONARY_NONE)
+    entries_[entry.next].prev = entry.prev;
+  else
+    tail_ = entry.prev;
+}
+
+void TraceDictionary::push_front(const uint32_t pos) {
+  Entry &entry = entries_[pos];
+  entry.prev = TRACE_DICTIONARY_NONE;
+  entry.next = head_;
+  if (head_ != TRACE_DICTIONARY_NONE)
+    entries_[head_].prev = pos;
+  head_ = pos;
+  if (tail_ == TRACE_DICTIONARY_NONE)
+    tail_ = pos;
+}
+
+} // namespace lib
+} // namespace freud
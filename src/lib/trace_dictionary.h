@@ -0,0 +1,73 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+namespace freud {
+namespace lib {
+
+// Remembers the ids of the most recently seen stack traces, up to a
+// fixed number of them, so that each trace needs to be written out in
+// full only once while it stays in use. Entries live in a preallocated
+// array, linked in LRU order. Not thread-safe, except for dump_stats().
+class TraceDictionary {
+ public:
+  explicit TraceDictionary(const size_t capacity);
+  ~TraceDictionary() = default;
+
+  // returns true if id was not known, i.e. its trace must be written
+  // out; either way, id becomes the most recently used one
+  bool insert(const uint64_t id);
+
+  void dump_stats(FILE *fp, const char *name) const;
+
+  // stable across runs, so that ids can be used as document ids
+  static uint64_t hash(const uint64_t *pcs, const size_t count);
+
+ private:
+  struct Entry {
+    uint64_t id;
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  const size_t capacity_;
+  std::vector<Entry> entries_;
+  std::unordered_map<uint64_t, uint32_t> index_;
+  // most and least recently used entries
+  uint32_t head_;
+  uint32_t tail_;
+
+  std::atomic<size_t> size_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+  std::atomic<uint64_t> evictions_;
+
+  void unlink(const uint32_t pos);
+  void push_front(const uint32_t pos);
+};
+
+} // namespace lib
+} // namespace freud
@@ -16,6 +16,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -33,8 +34,8 @@ std::condition_variable signal_cv;
 int last_signal = 0;
 
 void signal_handler(const int signum) {
-  if (signum != SIGTERM && signum != SIGINT)
-    // treat only these two signals
+  if (signum != SIGTERM && signum != SIGINT && signum != SIGUSR1 && signum != SIGUSR2)
+    // treat only these signals
     return;
 
   {
@@ -59,7 +60,33 @@ bool setup_signal_handler() {
     fprintf(stderr, "ERROR: sigaction(SIGINT) failed: %s\n", strerror(errno));
     return false;
   }
+  if (sigaction(SIGUSR1, &action, NULL) < 0) {
+    fprintf(stderr, "ERROR: sigaction(SIGUSR1) failed: %s\n", strerror(errno));
+    return false;
+  }
+  if (sigaction(SIGUSR2, &action, NULL) < 0) {
+    fprintf(stderr, "ERROR: sigaction(SIGUSR2) failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  return true;
+}
 
+// block the signals treated by signal_handler() in the calling thread,
+// and in every thread it spawns from now on; the previous mask is saved
+// in old_mask
+bool block_signals(sigset_t *old_mask) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGUSR2);
+  const int res = pthread_sigmask(SIG_BLOCK, &mask, old_mask);
+  if (res) {
+    fprintf(stderr, "ERROR: pthread_sigmask: %s\n", strerror(res));
+    return false;
+  }
   return true;
 }
 
@@ -91,6 +118,13 @@ int main(const int argc, const char *argv[]) {
     return 1;
   }
 
+  // signals are only handled by this thread: the others, listeners
+  // above all, never see their system calls interrupted. Any signal
+  // received in the meantime is delivered once it is unblocked below
+  sigset_t old_mask;
+  if (!block_signals(&old_mask))
+    return 1;
+
   // read configuration
   freud::lib::Configurator config(argc, argv);
 
@@ -109,24 +143,43 @@ int main(const int argc, const char *argv[]) {
 
   freud::lib::Dispatcher dispatcher(config, &db, &es);
 
-  freud::lib::ThreadedUDPServer udp(&dispatcher);
+  freud::lib::ThreadedUDPServer udp(config, &dispatcher);
   uint16_t port = udp.start_listening();
   fprintf(stderr, "INFO: UDP server listening on port: %d\n", port);
 
   create_portfile(config, port);
 
+  // all threads are running
+  const int res = pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  if (res)
+    fprintf(stderr, "ERROR: pthread_sigmask: %s\n", strerror(res));
+
   // the big waiting loop
   while (true) {
-    std::unique_lock<std::mutex> lock(signal_mutex);
-    signal_cv.wait(lock, []{return last_signal != 0;});
-
-    if (last_signal == SIGTERM || last_signal == SIGINT)
+    int signum;
+    {
+      std::unique_lock<std::mutex> lock(signal_mutex);
+      signal_cv.wait(lock, []{return last_signal != 0;});
+      // reset value of last signal received; the lock is not held
+      // while acting on it, as the handler runs on this very thread
+      signum = last_signal;
+      last_signal = 0;
+    }
+
+    if (signum == SIGTERM || signum == SIGINT)
       // if interruption signal is received, break out of the loop to
       // initiate a shutdown
       break;
 
-    // reset value of last signal received
-    last_signal = 0;
+    if (signum == SIGUSR1) {
+      // dump all counters to the log
+      udp.dump_stats(stderr);
+      dispatcher.dump_stats(stderr);
+    }
+
+    if (signum == SIGUSR2)
+      // replay the DB cache to ES
+      dispatcher.replay_db();
   }
 
   delete_portfile(config);
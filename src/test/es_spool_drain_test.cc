@@ -0,0 +1,214 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The spool must drain after an outage even while new documents keep
+// arriving faster than one request round trip per payload: while it
+// holds anything, new payloads go through it too, so only replaying
+// several payloads at once lets it catch up.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lib/configurator.h"
+#include "lib/es_bulk.h"
+
+using freud::lib::Configurator;
+using freud::lib::ElasticSearchBulkWriter;
+
+#define DOCS_PER_PAYLOAD 10
+#define MAX_INFLIGHT 8
+// per request, once ES is back
+#define ES_DELAY_USEC 20000
+// new payloads arrive 4 times faster than a single request can go
+#define ADD_INTERVAL_USEC (ES_DELAY_USEC / 4)
+#define OUTAGE_PAYLOADS 50
+#define TIMEOUT_SEC 15
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return 1;                                                         \
+    }                                                                   \
+  } while (0)
+
+namespace {
+
+// Just enough of the _bulk endpoint: one thread per keep-alive
+// connection, every document accepted, or the whole request failed
+// with a 503 during the outage.
+class StubEs {
+ public:
+  StubEs() : failing_(true), docs_(0), listen_fd_(-1), port_(0) {}
+
+  bool start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (listen_fd_ < 0 || bind(listen_fd_, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+        listen(listen_fd_, 64) < 0 || getsockname(listen_fd_, (struct sockaddr*) &addr, &len) < 0)
+      return false;
+    port_ = ntohs(addr.sin_port);
+    // the accept thread and its connections live as long as the test
+    std::thread(&StubEs::accept_fn, this).detach();
+    return true;
+  }
+
+  std::string get_address() const { return "http://127.0.0.1:" + std::to_string(port_) + "/"; }
+  void set_failing(const bool failing) { failing_ = failing; }
+  uint64_t get_docs() const { return docs_.load(); }
+
+ private:
+  std::atomic<bool> failing_;
+  std::atomic<uint64_t> docs_;
+  int listen_fd_;
+  uint16_t port_;
+
+  void accept_fn() {
+    int fd;
+    while ((fd = accept(listen_fd_, NULL, NULL)) >= 0)
+      std::thread(&StubEs::serve_fn, this, fd).detach();
+  }
+
+  void serve_fn(const int fd) {
+    std::string in;
+    char buf[65536];
+    while (true) {
+      size_t header_end;
+      while ((header_end = in.find("\r\n\r\n")) == std::string::npos) {
+        const ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0) {
+          close(fd);
+          return;
+        }
+        in.append(buf, res);
+      }
+
+      size_t body_len = 0;
+      for (size_t pos = in.find("\r\n"); pos < header_end; pos = in.find("\r\n", pos + 2))
+        if (!strncasecmp(in.c_str() + pos + 2, "Content-Length:", strlen("Content-Length:")))
+          body_len = strtoull(in.c_str() + pos + 2 + strlen("Content-Length:"), NULL, 10);
+      while (in.size() < header_end + 4 + body_len) {
+        const ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0) {
+          close(fd);
+          return;
+        }
+        in.append(buf, res);
+      }
+
+      uint64_t docs = 0;
+      const std::string body = in.substr(header_end + 4, body_len);
+      for (size_t pos = body.find("{\"index\""); pos != std::string::npos; pos = body.find("{\"index\"", pos + 1))
+        ++docs;
+      in.erase(0, header_end + 4 + body_len);
+
+      std::string response;
+      if (failing_.load()) {
+        response = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 2\r\n\r\n{}";
+      } else {
+        usleep(ES_DELAY_USEC);
+        docs_.fetch_add(docs);
+        const std::string json = "{\"took\":1,\"errors\":false,\"items\":[]}";
+        response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+            std::to_string(json.size()) + "\r\n\r\n" + json;
+      }
+      if (write(fd, response.data(), response.size()) != (ssize_t) response.size()) {
+        close(fd);
+        return;
+      }
+    }
+  }
+};
+
+void add_payload(ElasticSearchBulkWriter *writer, uint64_t *added) {
+  for (int i = 0; i < DOCS_PER_PAYLOAD; ++i)
+    writer->add("test-2016.01.01", "summary-report", "{}");
+  *added += DOCS_PER_PAYLOAD;
+}
+
+} // namespace
+
+int main() {
+  StubEs es;
+  CHECK(es.start());
+
+  char dir[] = "/tmp/es_spool_drain_test.XXXXXX";
+  CHECK(mkdtemp(dir));
+  const std::string conf_path = std::string(dir) + "/sigmund.conf";
+  FILE *fp = fopen(conf_path.c_str(), "w");
+  CHECK(fp);
+  fprintf(fp, "db_dir=%s\nes_bulk_max_docs=%d\nes_bulk_max_retries=0\nes_max_inflight=%d\n",
+          dir, DOCS_PER_PAYLOAD, MAX_INFLIGHT);
+  fclose(fp);
+  const char *argv[] = { "es_spool_drain_test", conf_path.c_str() };
+  Configurator config(2, argv);
+
+  uint64_t added = 0;
+  bool drained = false;
+  {
+    ElasticSearchBulkWriter writer(std::vector<std::string>(1, es.get_address()), config);
+    CHECK(writer.init());
+
+    // the outage: the first failure spools, and so does all that follows
+    for (int i = 0; i < OUTAGE_PAYLOADS; ++i) {
+      add_payload(&writer, &added);
+      for (int j = 0; j < 10; ++j)
+        (void) writer.poll(true);
+    }
+    CHECK(writer.get_spool_bytes() > 0);
+
+    // ES is back, but new documents keep coming
+    es.set_failing(false);
+    const time_t until = time(NULL) + TIMEOUT_SEC;
+    while (!drained && time(NULL) < until) {
+      add_payload(&writer, &added);
+      usleep(ADD_INTERVAL_USEC);
+      (void) writer.poll(false);
+      drained = writer.get_spool_bytes() == 0;
+    }
+
+    if (!drained)
+      writer.dump_stats(stderr);
+    // wait for everything still in flight
+    writer.flush_all();
+  }
+
+  CHECK(drained);
+  // nothing lost, nothing sent twice
+  CHECK(es.get_docs() == added);
+
+  const std::string rm = std::string("rm -rf ") + dir;
+  if (system(rm.c_str()) != 0)
+    fprintf(stderr, "could not remove %s\n", dir);
+  return 0;
+}
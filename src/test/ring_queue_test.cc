@@ -0,0 +1,104 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// No wake-up may be lost: producers push short bursts and wait for the
+// consumer to drain each of them, so the consumer goes back to sleep
+// (with no timeout, like the dispatcher shards) all the time. A lost
+// ring leaves a burst in the queue with the consumer asleep.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "lib/ring_queue.h"
+
+using freud::lib::RingQueue;
+
+#define CAPACITY 1024
+#define BURSTS 100000
+#define MAX_BURST 8
+#define TIMEOUT_SEC 10
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return 1;                                                         \
+    }                                                                   \
+  } while (0)
+
+namespace {
+
+// returns false if the consumer stalled
+bool run(const size_t producers) {
+  RingQueue<uint64_t> queue(CAPACITY);
+  std::vector<uint64_t> values(MAX_BURST);
+  std::atomic<uint64_t> popped(0);
+  std::atomic<bool> stalled(false);
+
+  std::thread consumer([&] {
+    while (queue.pop_or_wait())
+      popped.fetch_add(1);
+  });
+
+  std::vector<std::thread*> writers;
+  for (size_t p = 0; p < producers; ++p)
+    writers.push_back(new std::thread([&, p] {
+      for (uint64_t i = p; i < BURSTS && !stalled.load(); i += producers) {
+        const size_t burst = 1 + i % MAX_BURST;
+        const uint64_t before = popped.load();
+        for (size_t j = 0; j < burst; ++j)
+          while (!queue.push(&values[j]))
+            std::this_thread::yield();
+
+        // the consumer must get to this burst without any further ring;
+        // bursts of other producers only make it count faster
+        const time_t until = time(NULL) + TIMEOUT_SEC;
+        while (popped.load() < before + burst && !stalled.load())
+          if (time(NULL) >= until) {
+            fprintf(stderr, "consumer asleep with %zu queued, burst %" PRIu64 "\n", burst, i);
+            stalled = true;
+          } else {
+            std::this_thread::yield();
+          }
+      }
+    }));
+
+  for (std::thread *writer : writers) {
+    writer->join();
+    delete writer;
+  }
+  // close() rings everyone, a stalled consumer exits too
+  queue.close();
+  consumer.join();
+
+  uint64_t pushed = 0;
+  for (uint64_t i = 0; i < BURSTS; ++i)
+    pushed += 1 + i % MAX_BURST;
+  return !stalled.load() && popped.load() == pushed;
+}
+
+} // namespace
+
+int main() {
+  CHECK(run(1));
+  CHECK(run(2));
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ *  SIGnatures Monitor and UNifier Daemon
+ *  Copyright (C) 2016  Marco Leogrande
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// A stalled sink must not starve the other one: it may only hold its
+// share of the message pool, and the healthy sink keeps receiving every
+// message.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "lib/sink_worker.h"
+
+using freud::lib::Configurator;
+using freud::lib::MsgBuffer;
+using freud::lib::MsgPool;
+using freud::lib::Sink;
+using freud::lib::SinkWorker;
+
+#define POOL_SIZE 256
+#define SINK_MAX_MSGS (POOL_SIZE / 4)
+#define BATCH_SIZE 8
+#define MESSAGES 2000
+#define TIMEOUT_SEC 10
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return 1;                                                         \
+    }                                                                   \
+  } while (0)
+
+namespace {
+
+// counts what it gets; blocks in consume_batch() while stalled
+class TestSink : public Sink {
+ public:
+  explicit TestSink(const bool stalled) : stalled_(stalled), consumed_(0) {}
+
+  const char* get_sink_name() const override { return stalled_ ? "stalled" : "healthy"; }
+
+  size_t consume_batch(MsgBuffer *const *, const size_t count) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{return !stalled_;});
+    consumed_.fetch_add(count);
+    return count;
+  }
+
+  void resume() {
+    std::lock_guard<std::mutex> lock_guard(mutex_);
+    stalled_ = false;
+    cv_.notify_all();
+  }
+
+  uint64_t get_consumed() const { return consumed_.load(); }
+
+ private:
+  bool stalled_;
+  std::atomic<uint64_t> consumed_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+time_t deadline() { return time(NULL) + TIMEOUT_SEC; }
+
+} // namespace
+
+int main() {
+  Configurator config;
+  MsgPool pool(POOL_SIZE);
+  TestSink stalled(true), healthy(false);
+  SinkWorker *stalled_worker = new SinkWorker(&stalled, config.get_db_queue(), SINK_MAX_MSGS, BATCH_SIZE, 0);
+  SinkWorker *healthy_worker = new SinkWorker(&healthy, config.get_es_queue(), SINK_MAX_MSGS, BATCH_SIZE, 0);
+
+  // fan out every message to both sinks, like the dispatcher does; wait
+  // for the healthy sink to catch up, so that it never drops anything
+  int result = 0;
+  uint64_t stalled_queued = 0;
+  for (uint64_t i = 0; i < MESSAGES && !result; ++i) {
+    MsgBuffer *msg = NULL;
+    const time_t until = deadline();
+    while (!(msg = pool.acquire()) && time(NULL) < until)
+      std::this_thread::yield();
+    if (!msg) {
+      fprintf(stderr, "pool exhausted at message %" PRIu64 ", %zu buffers available\n", i, pool.get_available());
+      result = 1;
+      break;
+    }
+
+    msg->set_size(1);
+    stalled_queued += stalled_worker->push_batch(&msg, 1);
+    if (healthy_worker->push_batch(&msg, 1) != 1) {
+      fprintf(stderr, "healthy sink dropped message %" PRIu64 "\n", i);
+      result = 1;
+    }
+    msg->unref();
+
+    while (healthy.get_consumed() < i + 1 && time(NULL) < until)
+      std::this_thread::yield();
+  }
+
+  // the stalled sink holds its share of the pool, and nothing more
+  const uint64_t healthy_consumed = healthy.get_consumed();
+  const uint64_t stalled_consumed = stalled.get_consumed();
+  const size_t available = pool.get_available();
+
+  // once resumed, the stalled sink drains what it held
+  stalled.resume();
+  delete stalled_worker;
+  delete healthy_worker;
+
+  CHECK(!result);
+  CHECK(healthy_consumed == MESSAGES);
+  CHECK(stalled_consumed == 0);
+  CHECK(stalled_queued > 0 && stalled_queued <= SINK_MAX_MSGS);
+  CHECK(available == POOL_SIZE - stalled_queued);
+  CHECK(stalled.get_consumed() == stalled_queued);
+  CHECK(pool.get_available() == POOL_SIZE);
+
+  return 0;
+}